@@ -0,0 +1,207 @@
+// svg2img v. 1.0
+// Header-only library for converting svg to raster images (png/jpeg/webp) via browser.
+// Required Emscripten/WebAssembly environment.
+// SPDX-FileCopyrightText: Copyright © 2024 Anatoly Petrov <petrov.projects@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Benchmark suite. Runs in a headless browser (see bench/run.mjs).
+// Converts a synthetic svg corpus with different output formats, zooms, concurrency levels,
+// backends, input modes, encoders, minification, canvas pooling, and deferred completions.
+// Prints the results as JSON lines to the browser console (one line per configuration)
+// followed by the "svg2img-bench: done" line.
+// The suite is built in several variants (see SVG2IMG_BENCH_BUILD in bench/CMakeLists.txt),
+// so the SIMD and shared-memory paths are measured as well.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <malloc.h>
+#include <string>
+#include <vector>
+
+#include "emscripten/emscripten.h"
+
+#include "svg2img.h"
+
+#ifndef SVG2IMG_BENCH_BUILD
+#define SVG2IMG_BENCH_BUILD "baseline"
+#endif
+
+namespace {
+    // Number of conversions per configuration.
+    // It should be large enough for p99 to be distinct from the max (nearest rank).
+    constexpr std::size_t iterations = 128;
+
+    // Svg document of the corpus.
+    struct Doc {
+        const char *name;
+        std::string svg;
+    };
+
+    // Benchmark configuration.
+    struct Config {
+        const Doc *doc;
+        const char *format;
+        float zoom;
+        std::size_t concurrency;
+        raster::Backend backend;
+        raster::Input input;
+        raster::Encoder encoder = raster::Encoder::Browser;
+        int level = 6; // See raster::SetEncoder().
+        bool minify = false;
+        std::size_t canvas_pool = 16; // See raster::SetCanvasPool().
+        bool deferred = false; // Completions are pumped from the main loop.
+    };
+
+    std::vector<Doc> corpus;
+    std::vector<Config> configs;
+    std::size_t current = 0;
+    std::vector<double> latencies;
+    double started = 0.0;
+    std::size_t peak_alloc = 0;
+
+    // Returns the number of bytes allocated on the WASM heap
+    // (unlike emscripten_get_heap_size(), which is the heap capacity).
+    std::size_t AllocatedBytes() {
+        return static_cast<std::size_t>(mallinfo().uordblks);
+    }
+
+    // Returns a deterministic svg (300x300) with the specified number of shapes.
+    std::string MakeSvg(const int shapes) {
+        std::string svg = R"(<svg width="300" height="300" xmlns="http://www.w3.org/2000/svg">)";
+        svg += R"(<rect width="300" height="300" fill="lavender"/>)";
+        // 64-bit LCG (Knuth's MMIX constants); the high 32 bits cover the 24-bit colors.
+        std::uint64_t seed = 42;
+        const auto next = [&seed](const std::uint32_t mod) {
+            seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+            return static_cast<std::uint32_t>(seed >> 32) % mod;
+        };
+        for (int i = 0; i < shapes; ++i) {
+            svg += std::format(R"(<path d="M{} {} L{} {} Q{} {} {} {} Z" fill="#{:06x}" )"
+                               R"(fill-opacity="0.5" stroke="#{:06x}"/>)",
+                               next(300), next(300), next(300), next(300), next(300), next(300),
+                               next(300), next(300), next(0x1000000), next(0x1000000));
+        }
+        svg += "</svg>";
+        return svg;
+    }
+
+    // Returns the percentile of the sorted values (nearest rank: ceil(p * n), 1-based).
+    double Percentile(const std::vector<double> &sorted, const double p) {
+        if (sorted.empty()) return 0.0;
+        const double n = static_cast<double>(sorted.size());
+        const auto rank = static_cast<std::size_t>(std::ceil(p * n));
+        return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+    }
+
+    void RunNext();
+
+    // Prints the results of the current configuration and runs the next one.
+    void Report(const std::size_t total, const std::size_t failed, void *) {
+        const double elapsed = emscripten_get_now() - started;
+        const Config &cfg = configs[current];
+        std::sort(latencies.begin(), latencies.end());
+        std::printf("%s\n", std::format(
+            R"({{"build":"{}","corpus":"{}","svg_bytes":{},"format":"{}","zoom":{},)"
+            R"("concurrency":{},"backend":"{}","input":"{}","encoder":"{}","level":{},)"
+            R"("minify":{},"canvas_pool":{},"deferred":{},"n":{},"samples":{},"failed":{},)"
+            R"("p50_ms":{:.3f},"p95_ms":{:.3f},"p99_ms":{:.3f},"max_ms":{:.3f},)"
+            R"("conv_per_sec":{:.2f},"peak_alloc_bytes":{}}})",
+            SVG2IMG_BENCH_BUILD, cfg.doc->name, cfg.doc->svg.size(), cfg.format, cfg.zoom,
+            cfg.concurrency, raster::ToCStr(cfg.backend), raster::ToCStr(cfg.input),
+            cfg.encoder == raster::Encoder::Wasm ? "wasm" : "browser", cfg.level,
+            cfg.minify, cfg.canvas_pool, cfg.deferred, total, latencies.size(), failed,
+            Percentile(latencies, 0.50), Percentile(latencies, 0.95), Percentile(latencies, 0.99),
+            latencies.empty() ? 0.0 : latencies.back(),
+            elapsed > 0.0 ? static_cast<double>(total) * 1000.0 / elapsed : 0.0,
+            peak_alloc).c_str());
+        ++current;
+        RunNext();
+    }
+
+    // Runs the current configuration as a batch.
+    void RunNext() {
+        if (current == configs.size()) {
+            std::printf("svg2img-bench: done\n");
+            return;
+        }
+        const Config &cfg = configs[current];
+        raster::SetBackend(cfg.backend);
+        raster::SetInput(cfg.input);
+        raster::SetEncoder(cfg.encoder, cfg.level);
+        raster::SetMinify(cfg.minify);
+        raster::SetCanvasPool(cfg.canvas_pool);
+        raster::SetDeferredCompletions(cfg.deferred);
+        latencies.clear();
+        peak_alloc = AllocatedBytes();
+        std::vector<raster::Job> jobs(iterations);
+        for (raster::Job &job : jobs) {
+            job.svg = cfg.doc->svg;
+            job.format = cfg.format;
+            job.zoom = cfg.zoom;
+            job.cb = [](std::string_view, raster::Error, void *) {
+                peak_alloc = std::max(peak_alloc, AllocatedBytes());
+            };
+        }
+        started = emscripten_get_now();
+        raster::SvgToImages(jobs, Report, nullptr, cfg.concurrency);
+    }
+}
+
+int main(int, char **) {
+    corpus = {{"small", MakeSvg(10)}, {"medium", MakeSvg(1000)}, {"large", MakeSvg(20000)}};
+    const char *formats[] = {"image/png", "image/jpeg", "image/webp"};
+    const float zooms[] = {0.5f, 1.0f, 2.0f};
+    const std::size_t concurrency[] = {1, 4, 16};
+
+    // Full sweep for the default pipeline.
+    for (const Doc &doc : corpus)
+        for (const char *format : formats)
+            for (const float zoom : zooms)
+                for (const std::size_t n : concurrency)
+                    configs.push_back({&doc, format, zoom, n,
+                                       raster::Backend::Main, raster::Input::DataUri});
+    // Pipeline modes.
+    for (const Doc &doc : corpus)
+        for (const char *format : formats) {
+            configs.push_back({&doc, format, 1.0f, 4, raster::Backend::Worker, raster::Input::DataUri});
+            configs.push_back({&doc, format, 1.0f, 4, raster::Backend::Main, raster::Input::Blob});
+            configs.push_back({&doc, format, 1.0f, 4, raster::Backend::Worker, raster::Input::Blob});
+            // Minification and the in-WASM uri encoding (SIMD in the simd builds).
+            for (const raster::Backend backend : {raster::Backend::Main, raster::Backend::Worker}) {
+                Config cfg{&doc, format, 1.0f, 4, backend, raster::Input::Uri};
+                configs.push_back(cfg);
+                cfg.minify = true;
+                configs.push_back(cfg);
+                cfg.input = raster::Input::Blob;
+                configs.push_back(cfg);
+            }
+            // Canvas pooling off vs the default, and deferred completions.
+            Config cfg{&doc, format, 1.0f, 16, raster::Backend::Main, raster::Input::DataUri};
+            cfg.canvas_pool = 0;
+            configs.push_back(cfg);
+            cfg.canvas_pool = 16;
+            cfg.deferred = true;
+            configs.push_back(cfg);
+        }
+    // In-WASM png encoder (SIMD filters in the simd builds) vs the browser one.
+    for (const Doc &doc : corpus)
+        for (const raster::Backend backend : {raster::Backend::Main, raster::Backend::Worker})
+            for (const int level : {0, 1, 6, 9}) {
+                Config cfg{&doc, "image/png", 1.0f, 4, backend, raster::Input::DataUri};
+                cfg.encoder = raster::Encoder::Wasm;
+                cfg.level = level;
+                configs.push_back(cfg);
+            }
+
+    // Latencies are collected per conversion (from the conversion start to the callback).
+    raster::SetStats(true, [](const raster::Sample &sample) {
+        latencies.push_back(sample.ms[static_cast<std::size_t>(raster::Stage::Total)]);
+    });
+    // Deferred completions are delivered from the frame, as an app would do it.
+    emscripten_set_main_loop([] { raster::PumpCompletions(2.0); }, 0, false);
+    RunNext();
+    return 0;
+}
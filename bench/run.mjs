@@ -0,0 +1,101 @@
+// svg2img v. 1.0
+// Header-only library for converting svg to raster images (png/jpeg/webp) via browser.
+// Required Emscripten/WebAssembly environment.
+// SPDX-FileCopyrightText: Copyright © 2024 Anatoly Petrov <petrov.projects@gmail.com>
+// SPDX-License-Identifier: MIT
+
+// Benchmark runner: serves the bench pages over http (workers need a non-opaque origin),
+// opens them one by one in a headless browser, collects the JSON lines from the console,
+// and writes them as a JSON array. The pages are cross-origin isolated (COOP/COEP headers),
+// so SharedArrayBuffer is available for the shared-memory build.
+//
+// Usage: node run.mjs <svg2img_bench.html>... [--browser chromium|firefox] [--out results.json]
+//                     [--timeout ms]
+
+import { readFile, writeFile } from "node:fs/promises";
+import { createServer } from "node:http";
+import { basename } from "node:path";
+import { chromium, firefox } from "playwright";
+
+function parseArgs(argv) {
+    const args = { html: [], browser: "chromium", out: "bench_results.json", timeout: 2 * 60 * 60 * 1000 };
+    for (let i = 0; i < argv.length; ++i) {
+        const arg = argv[i];
+        if (arg === "--browser") args.browser = argv[++i];
+        else if (arg === "--out") args.out = argv[++i];
+        else if (arg === "--timeout") args.timeout = Number(argv[++i]);
+        else args.html.push(arg);
+    }
+    if (args.html.length === 0) throw new Error("Missing path to svg2img_bench.html");
+    if (args.browser !== "chromium" && args.browser !== "firefox") {
+        throw new Error(`Unknown browser: ${args.browser}`);
+    }
+    return args;
+}
+
+const args = parseArgs(process.argv.slice(2));
+const pages = new Map(); // url path -> html
+for (const path of args.html) pages.set("/" + basename(path), await readFile(path));
+
+const server = createServer((req, res) => {
+    const html = pages.get(req.url);
+    if (!html) {
+        res.writeHead(404).end();
+        return;
+    }
+    res.writeHead(200, {
+        "Content-Type": "text/html",
+        "Cross-Origin-Opener-Policy": "same-origin",
+        "Cross-Origin-Embedder-Policy": "require-corp",
+    }).end(html);
+});
+await new Promise(resolve => server.listen(0, "127.0.0.1", resolve));
+
+const browser = await (args.browser === "firefox" ? firefox : chromium).launch({ headless: true });
+const results = [];
+
+// Runs the page until the "done" line and collects its results.
+async function runPage(name) {
+    let timer = null;
+    const page = await browser.newPage();
+    try {
+        const done = new Promise((resolve, reject) => {
+            page.on("console", msg => {
+                const text = msg.text();
+                if (text === "svg2img-bench: done") {
+                    resolve();
+                } else if (text.startsWith("{")) {
+                    const result = JSON.parse(text);
+                    results.push(result);
+                    console.log(`${result.build} ${result.corpus} ${result.format} zoom=${result.zoom} `
+                        + `n=${result.concurrency} ${result.backend} ${result.input} `
+                        + `${result.encoder}/${result.level} minify=${result.minify} `
+                        + `pool=${result.canvas_pool} deferred=${result.deferred}: `
+                        + `p50=${result.p50_ms}ms p95=${result.p95_ms}ms p99=${result.p99_ms}ms `
+                        + `max=${result.max_ms}ms (${result.samples} samples) `
+                        + `${result.conv_per_sec}/s alloc=${result.peak_alloc_bytes}`);
+                }
+            });
+            page.on("pageerror", reject);
+            timer = setTimeout(() => reject(new Error(`Benchmark timed out: ${name}`)), args.timeout);
+        });
+        await page.goto(`http://127.0.0.1:${server.address().port}${name}`);
+        if (name.includes("shared") && !(await page.evaluate(() => self.crossOriginIsolated))) {
+            throw new Error(`The page is not cross-origin isolated: ${name}`);
+        }
+        await done;
+    } finally {
+        clearTimeout(timer);
+        await page.close();
+    }
+}
+
+try {
+    for (const name of pages.keys()) await runPage(name);
+} finally {
+    await browser.close();
+    server.close();
+}
+
+await writeFile(args.out, JSON.stringify({ browser: args.browser, results }, null, 2));
+console.log(`Written ${results.length} results to ${args.out}`);
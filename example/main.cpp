@@ -14,6 +14,7 @@
 
 #include "emscripten/em_js.h"
 #include "emscripten/emscripten.h"
+#include "emscripten/html5.h"
 #include "GLFW/glfw3.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -47,6 +48,9 @@ static void GlfwErrCb(int, const char *desc) { Alert(desc); }
 bool LoadTextureFromMemory(const char *data, size_t size, GLuint *out_texture,
                            float *out_width, float *out_height);
 
+bool LoadTextureFromPixels(const raster::Pixels &px, GLuint *out_texture,
+                           float *out_width, float *out_height);
+
 // Draws Svg2Img Demo.
 // You are here for this example!
 void Svg2ImgDemo() {
@@ -56,12 +60,16 @@ void Svg2ImgDemo() {
     static char text[buf_size]{};
     static const char *all_formats[3] = {"image/png", "image/jpeg", "image/webp"};
     static int format_idx = 0;
+    static const char *all_outputs[3] = {"encoded", "raw rgba", "texture"};
+    static int output_idx = 0;
     static float quality = 1.0f, x = 0.0f, y = 0.0f, width = 0.0f, height = 0.0f,
                  zoom = 1.0f;
+    static bool worker = false, blob = false;
     static float out_width = 0.0f, out_height = 0.0;
     static size_t out_size = 0;
+    static bool out_raw = false;
     static const char *out_err = "RasterError::None";
-    static std::string out_img;
+    static raster::ImageBuffer out_img;
     static GLuint texture = 0;
 
     // Sets default svg example as text.
@@ -69,9 +77,9 @@ void Svg2ImgDemo() {
 
     // Clears the image and associated data.
     static auto clear_image = [] {
-        out_width = 0.0f, out_height = 0.0f, out_size = 0;
+        out_width = 0.0f, out_height = 0.0f, out_size = 0, out_raw = false;
         out_err = "RasterError::None";
-        out_img.clear();
+        out_img.reset();
         if (texture) glDeleteTextures(1, &texture);
         texture = 0;
     };
@@ -80,12 +88,15 @@ void Svg2ImgDemo() {
     static auto reset_opts = [] {
         format_idx = 0;
         quality = 1.0f, x = 0.0f, y = 0.0f, width = 0.0f, height = 0.0f, zoom = 0.0f;
+        output_idx = 0;
+        worker = false, blob = false;
     };
 
     // Callback for the raster::SvgToImage().
     // Thanks to the std::function<>, we may pass as a callback ordinary functions,
     // lambdas, functors, etc.
-    static auto cb = [](const std::string_view img, const raster::Error err, void *) {
+    // We take the ownership of the image buffer, so the image data isn't copied.
+    static auto cb = [](raster::ImageBuffer img, const raster::Error err, void *) {
         if (static_cast<bool>(err)) {
             out_err = raster::ToCStr(err);
             Alert(std::format("Error occurs: {}", out_err).c_str());
@@ -93,10 +104,37 @@ void Svg2ImgDemo() {
         }
         // no error
         out_size = img.size();
-        // Note that raster::SvgToImage() frees the image buffer after the callback returns.
-        // Copy the image data if you want to use it further.
-        out_img = img;
         LoadTextureFromMemory(img.data(), img.size(), &texture, &out_width, &out_height);
+        out_img = std::move(img);
+    };
+
+    // Callback for the raster::SvgToImage() with raw pixels.
+    // Pixels go directly to the texture, so we don't need to decode the image with stb.
+    static auto pixel_cb = [](const raster::Pixels &px, const raster::Error err, void *) {
+        if (static_cast<bool>(err)) {
+            out_err = raster::ToCStr(err);
+            Alert(std::format("Error occurs: {}", out_err).c_str());
+            return;
+        }
+        // no error
+        out_size = px.data.size();
+        out_raw = true;
+        LoadTextureFromPixels(px, &texture, &out_width, &out_height);
+    };
+
+    // Callback for the raster::SvgToTexture().
+    // The texture is ready to use, so we don't need any OpenGL calls at all.
+    static auto texture_cb = [](const raster::Texture &tex, const raster::Error err, void *) {
+        if (static_cast<bool>(err)) {
+            out_err = raster::ToCStr(err);
+            Alert(std::format("Error occurs: {}", out_err).c_str());
+            return;
+        }
+        // no error
+        out_raw = true;
+        texture = tex.id;
+        out_width = static_cast<float>(tex.width);
+        out_height = static_cast<float>(tex.height);
     };
 
     // UI
@@ -120,8 +158,17 @@ void Svg2ImgDemo() {
         ImGui::SeparatorText("Actions");
         if (ImGui::Button("Convert to img")) {
             clear_image();
-            raster::SvgToImage({text}, cb, nullptr, all_formats[format_idx],
-                               quality, x, y, width, height, zoom);
+            raster::SetBackend(worker ? raster::Backend::Worker : raster::Backend::Main);
+            raster::SetInput(blob ? raster::Input::Blob : raster::Input::DataUri);
+            if (output_idx == 1) {
+                raster::SvgToImage({text}, pixel_cb, nullptr, x, y, width, height, zoom);
+            } else if (output_idx == 2) {
+                raster::SvgToTexture({text}, emscripten_webgl_get_current_context(),
+                                     texture_cb, nullptr, x, y, width, height, zoom);
+            } else {
+                raster::SvgToImage({text}, cb, nullptr, all_formats[format_idx],
+                                   quality, x, y, width, height, zoom);
+            }
         }
         ImGui::SameLine();
         if (ImGui::Button("Clear text")) { memset(text, 0, buf_size); }
@@ -132,8 +179,9 @@ void Svg2ImgDemo() {
         ImGui::SeparatorText("Image");
         ImGui::Text("%s | Size (bytes) %zu | W %.3f | H %.3f",
                     out_err, out_size, out_width, out_height);
-        const char * out_fmt = raster::ToCStr(raster::GetImageFormat(out_img));
-        const std::string header = raster::GetImageHeader(out_img, 0, 12);
+        const char * out_fmt = out_raw ? raster::ToCStr(raster::Format::RawRgba)
+                                       : raster::ToCStr(raster::GetImageFormat(out_img.view()));
+        const std::string header = raster::GetImageHeader(out_img.view(), 0, 12);
         ImGui::Text("Format %s | Header (12 bytes) %s", out_fmt, header.c_str());
         if (texture) {
             ImGui::Image(texture, ImVec2(out_width, out_height));
@@ -151,6 +199,10 @@ void Svg2ImgDemo() {
         ImGui::InputFloat("width", &width, 10);
         ImGui::InputFloat("height", &height, 10);
         ImGui::InputFloat("zoom", &zoom, 0.25);
+        ImGui::Checkbox("worker backend", &worker);
+        ImGui::SameLine();
+        ImGui::Checkbox("blob input", &blob);
+        ImGui::Combo("output", &output_idx, all_outputs, std::size(all_outputs));
 
         // Pop spacing
         ImGui::PopStyleVar();
@@ -197,6 +249,31 @@ bool LoadTextureFromMemory(const char *data, const size_t size, GLuint *out_text
     return true;
 }
 
+// Loads raw RGBA pixels into an OpenGL texture.
+bool LoadTextureFromPixels(const raster::Pixels &px, GLuint *out_texture,
+                           float *out_width, float *out_height) {
+    // Create an OpenGL texture identifier
+    GLuint img_texture;
+    glGenTextures(1, &img_texture);
+    glBindTexture(GL_TEXTURE_2D, img_texture);
+
+    // Setup filtering parameters for display
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Upload pixels into texture
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, px.stride / 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, px.width, px.height, 0, GL_RGBA,
+                 GL_UNSIGNED_BYTE, px.data.data());
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+
+    *out_texture = img_texture;
+    *out_width = static_cast<float>(px.width);
+    *out_height = static_cast<float>(px.height);
+
+    return true;
+}
+
 // Renders a new frame.
 // Based on https://github.com/ocornut/imgui/blob/master/examples/example_glfw_opengl3/main.cpp
 // The original decision was created by Omar Cornut (https://github.com/ocornut) and other contributors (if present).
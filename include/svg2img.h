@@ -10,15 +10,57 @@
 #define EMSCRIPTEN_SVG2IMG_H
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
+#include <coroutine>
+#include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
 #include <format>
 #include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <new>
+#include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "emscripten/em_macros.h"
+#include "emscripten/emscripten.h"
+#include "emscripten/html5_webgl.h"
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+// ============================================================================
+// Configuration
+// ============================================================================
+
+// Number of pending-request slots (see the templated raster::SvgToImage()).
+#ifndef SVG2IMG_SLOT_COUNT
+#define SVG2IMG_SLOT_COUNT 256
+#endif
+
+// Size of the callable storage of the pending-request slot (in bytes).
+#ifndef SVG2IMG_SLOT_SIZE
+#define SVG2IMG_SLOT_SIZE 48
+#endif
+
+// Default backend (a raster::Backend enumerator, see raster::SetBackend()).
+// E.g., -DSVG2IMG_DEFAULT_BACKEND=Native for builds without DOM (prerendering, Node).
+#ifndef SVG2IMG_DEFAULT_BACKEND
+#define SVG2IMG_DEFAULT_BACKEND Main
+#endif
 
 // ============================================================================
 // End-user api
@@ -34,25 +76,84 @@ namespace raster {
     // Thus, it is highly likely that UriEncodingFailed/ImgLoadingFailed was thrown because of the
     // broken svg; CanvasDrawingFailed/BlobExportFailed - because the image parameters
     // are invalid or unsupported by the browser (for example, the output size is too large).
+    // TextureUploadFailed is specific for raster::SvgToTexture(), which uploads <canvas>
+    // to the WebGL texture instead of the blob export.
     enum class Error: int {
         None = 0, // Svg successfully rasterized.
         NoInputData, // Missed input data.
-        UriEncodingFailed, // Unable to encode svg as data uri.
+        UriEncodingFailed, // Unable to encode svg as data uri (or wrap it in a blob).
         ImgLoadingFailed, // Unable to load svg to <img>.
         CanvasDrawingFailed, // Unable to draw an image on <canvas>.
         BlobExportFailed, // Unable to extract blob from <canvas>.
+        TextureUploadFailed, // Unable to upload an image to the WebGL texture.
+        Cancelled, // The conversion was cancelled (see raster::Request::Cancel()).
+        Timeout, // The conversion wasn't completed in time (see raster::Request::SetTimeout()).
+        NoRasterizer, // Backend::Native is selected, but no rasterizer is registered.
     };
 
     // Possible raster formats.
     // The raster::SvgToImage() function returns a png image if the user-specified format
     // is not supported by the browser. Thus, the end user needs to have an api to easily
     // deduce the resulting format. This api includes the below enumeration and the following
-    // helper functions: raster::GetImageHeader(), raster::GetImageFormat().
+    // helper functions: raster::GetImageHeader(), raster::GetImageFormat(), raster::GetImageInfo().
+    // RawRgba denotes raw pixels produced by the raster::SvgToImage() overload
+    // with raster::PixelCallback. Raw pixels have no header, so raster::GetImageFormat()
+    // never returns this value. New formats go after Unknown, so the codes clients
+    // may store or compare keep their values.
     enum class Format: int {
         Png = 0,
         Jpeg,
         Webp,
         Unknown,
+        RawRgba,
+    };
+    static_assert(static_cast<int>(Format::Unknown) == 3, "Format codes changed [raster::Format]");
+
+    // Possible rasterization backends.
+    // Main - <img> and <canvas> on the browser main thread (default).
+    // Worker - the <img> is decoded to ImageBitmap via createImageBitmap() and transferred
+    // to a pool of Web Workers (see raster::SetWorkerPool()), which draw it on OffscreenCanvas
+    // and encode the output with convertToBlob(). Thus, drawing and encoding don't block
+    // the main loop.
+    // Note that the svg itself is still parsed by <img> on the main thread because browsers
+    // don't decode svg in workers (there is no DOM). If the browser doesn't support
+    // Worker/OffscreenCanvas, the Worker backend silently falls back to Main.
+    // Native - the in-WASM rasterizer (see raster::Rasterizer) without DOM and JS round-trips.
+    // Pixels are produced directly in linear memory and encoded to png in C++ (other formats
+    // fall back to png, as in browsers). The conversion is synchronous: the callback is called
+    // before the conversion function returns. If no rasterizer is registered, the conversions
+    // fail with Error::NoRasterizer (there may be no DOM to fall back to).
+    // Multiple outputs and tiles always use the browser.
+    enum class Backend: int {
+        Main = 0,
+        Worker,
+        Native,
+    };
+
+    // Possible ways to pass svg to <img>.
+    // DataUri - svg is percent-encoded as data uri (default).
+    // Blob - the svg bytes are wrapped in a Blob (image/svg+xml) directly from the WASM heap
+    // and loaded via an object URL. It avoids the UTF-16 string copy and the percent-encoding,
+    // which are expensive for large svgs. The object URL is revoked when the conversion completes.
+    // Uri - svg is percent-encoded as data uri in WASM, and JS receives the ready uri.
+    // Only the bytes invalid in the uri are escaped, so the uri is smaller than with DataUri,
+    // and there is no UTF-16 copy of svg and no encodeURIComponent() call.
+    enum class Input: int {
+        DataUri = 0,
+        Blob,
+        Uri,
+    };
+
+    // Possible png encoders (see raster::SetEncoder()).
+    // Browser - canvas.toBlob()/convertToBlob() (default). Fast, but the compression level
+    // is up to the browser and can't be selected.
+    // Wasm - the image is read back as RGBA pixels via getImageData() (or taken directly from
+    // the native backend) and encoded in C++ with the selectable level. The row filters are
+    // vectorized with WASM SIMD if the module is built with -msimd128.
+    // Only png is encoded in WASM; jpeg and webp are always encoded by the browser.
+    enum class Encoder: int {
+        Browser = 0,
+        Wasm,
     };
 
     // Core
@@ -63,6 +164,137 @@ namespace raster {
     // raster::SvgToImage() shows an alert message in the browser.
     using Callback = std::function<void(std::string_view img, Error err, void *meta)>;
 
+    // Raw pixels of the rasterized image.
+    // Pixels are stored as RGBA (8 bits per channel, non-premultiplied alpha), rows go
+    // from top to bottom without padding. Thus, the data may be passed directly to
+    // glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, ...).
+    struct Pixels {
+        std::string_view data; // Pixel buffer (stride * height bytes).
+        int width = 0; // Image width in pixels.
+        int height = 0; // Image height in pixels.
+        int stride = 0; // Row length in bytes.
+    };
+
+    // Client's callback type for raw pixels (see raster::Callback for details).
+    using PixelCallback = std::function<void(const Pixels &px, Error err, void *meta)>;
+
+    // WebGL texture with the rasterized image.
+    // The texture belongs to the client, so it should be deleted with glDeleteTextures().
+    // Textures are created by the JS runtime, so the header needs no GL headers or symbols.
+    struct Texture {
+        unsigned int id = 0; // Texture name, GLuint (0 if rasterization failed).
+        int width = 0; // Image width in pixels.
+        int height = 0; // Image height in pixels.
+    };
+
+    // Client's callback type for textures (see raster::Callback for details).
+    using TextureCallback = std::function<void(const Texture &tex, Error err, void *meta)>;
+
+    // Client's allocator for raster::ImageBuffer.
+    // Alloc should return storage for size bytes in the WASM heap or nullptr
+    // (then the buffer is allocated with malloc). Free releases the storage returned by alloc.
+    // Ctx is passed to both functions as is.
+    struct Allocator {
+        void *(*alloc)(std::size_t size, void *ctx) = nullptr;
+        void (*free)(void *data, std::size_t size, void *ctx) = nullptr;
+        void *ctx = nullptr;
+    };
+
+    // Owning buffer with the rasterized image.
+    // The buffer is filled by JS directly (without intermediate copies), and the client
+    // may keep it as long as needed instead of copying the image data.
+    // The storage is released by the deleter on destruction.
+    class ImageBuffer {
+    public:
+        using Deleter = void (*)(void *data, std::size_t size, void *ctx);
+
+        ImageBuffer() = default;
+
+        // Takes ownership of the data, which will be released with deleter(data, size, ctx).
+        ImageBuffer(char *data, const std::size_t size, const Deleter deleter, void *ctx) noexcept
+            : data_(data), size_(size), deleter_(deleter), ctx_(ctx) {}
+
+        ImageBuffer(ImageBuffer &&other) noexcept
+            : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)),
+              deleter_(other.deleter_), ctx_(other.ctx_) {}
+
+        ImageBuffer &operator=(ImageBuffer &&other) noexcept {
+            if (this != &other) {
+                reset();
+                data_ = std::exchange(other.data_, nullptr);
+                size_ = std::exchange(other.size_, 0);
+                deleter_ = other.deleter_;
+                ctx_ = other.ctx_;
+            }
+            return *this;
+        }
+
+        ImageBuffer(const ImageBuffer &) = delete;
+        ImageBuffer &operator=(const ImageBuffer &) = delete;
+
+        ~ImageBuffer() { reset(); }
+
+        char *data() const noexcept { return data_; }
+        std::size_t size() const noexcept { return size_; }
+        bool empty() const noexcept { return size_ == 0; }
+        std::string_view view() const noexcept { return {data_, size_}; }
+
+        // Releases the ownership. The client becomes responsible for freeing the data
+        // with the deleter (see get_deleter()).
+        char *release() noexcept {
+            size_ = 0;
+            return std::exchange(data_, nullptr);
+        }
+
+        Deleter get_deleter() const noexcept { return deleter_; }
+        void *get_deleter_ctx() const noexcept { return ctx_; }
+
+        // Frees the data.
+        void reset() noexcept {
+            if (data_ != nullptr and deleter_ != nullptr) deleter_(data_, size_, ctx_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+    private:
+        char *data_ = nullptr;
+        std::size_t size_ = 0;
+        Deleter deleter_ = nullptr;
+        void *ctx_ = nullptr;
+    };
+
+    // Client's callback type for owning image buffers (see raster::Callback for details).
+    using BufferCallback = std::function<void(ImageBuffer img, Error err, void *meta)>;
+
+    // Handle of the pending conversion (see raster::SvgToImage()).
+    // The handle doesn't own the conversion, so it may be copied or dropped freely.
+    // Calls for the completed conversions do nothing. The handle is empty
+    // if the conversion was completed synchronously. With coalescing (raster::SetCoalescing()),
+    // each caller gets its own handle (with a negative id) for its callback.
+    class Request {
+    public:
+        Request() = default;
+
+        explicit Request(const int id) noexcept : id_(id) {}
+
+        // Cancels the conversion: the callback is called with Error::Cancelled before
+        // the function returns, and the stages not reached yet (drawing, export, copy)
+        // are skipped. The browser can't abort the already started stage, so its result
+        // is dropped. For the coalesced conversion, only the callback of this handle is detached
+        // (and called back), and the conversion itself is cancelled when no callbacks remain.
+        inline void Cancel() const;
+
+        // Cancels the conversion with Error::Timeout if it is not completed in ms milliseconds.
+        // Repeated calls replace the previous timeout.
+        inline void SetTimeout(double ms) const;
+
+        int GetId() const noexcept { return id_; }
+        explicit operator bool() const noexcept { return id_ != 0; }
+
+    private:
+        int id_ = 0;
+    };
+
     // Asynchronously converts svg to raster image via the browser (C++ facade).
     // A client may specify metadata for the callback, output image format
     // ("image/png", "image/jpeg", "image/webp" - support depends on the browser),
@@ -70,10 +302,891 @@ namespace raster {
     // the output image size (width, height), and the output zoom.
     // Note that the output image buffer is deallocated after the callback returns.
     // Thus, you should copy the image data to use it further.
-    inline void SvgToImage(std::string_view svg, Callback cb, void *meta = nullptr,
-                           const std::string& format = "image/png", float quality = 1.0f,
-                           float x = 0.0f, float y = 0.0f, float width = 0.0f, float height = 0.0f,
-                           float zoom = 1.0f);
+    // Returns the handle of the conversion, which may be cancelled (see raster::Request).
+    inline Request SvgToImage(std::string_view svg, Callback cb, void *meta = nullptr,
+                              const std::string& format = "image/png", float quality = 1.0f,
+                              float x = 0.0f, float y = 0.0f, float width = 0.0f,
+                              float height = 0.0f, float zoom = 1.0f);
+
+    // Asynchronously converts svg to raster image via the browser (C++ facade).
+    // The same as the overload with raster::Callback, but without std::function.
+    // Accepts any callable with the raster::Callback signature. The callable is moved
+    // to the pre-allocated pending-request slot and invoked in place, so the call doesn't
+    // allocate. If the callable doesn't fit the slot (see SVG2IMG_SLOT_SIZE), all slots
+    // are busy (see SVG2IMG_SLOT_COUNT), or coalescing is enabled, the callable is wrapped
+    // in raster::Callback as usual.
+    template<class F>
+        requires std::is_invocable_v<std::decay_t<F> &, std::string_view, Error, void *>
+    inline Request SvgToImage(std::string_view svg, F &&cb, void *meta = nullptr,
+                              const std::string& format = "image/png", float quality = 1.0f,
+                              float x = 0.0f, float y = 0.0f, float width = 0.0f,
+                              float height = 0.0f, float zoom = 1.0f);
+
+    // Asynchronously converts svg given as a scatter list of chunks via the browser (C++ facade).
+    // Use it for generated svgs (e.g., the header, thousands of paths, and the footer):
+    // the chunks are passed to the Blob constructor as views of the WASM heap, so the document
+    // is never assembled in a contiguous buffer on either side (raster::Input is ignored).
+    // The chunks are read before the function returns, so they may be released right after.
+    // Coalescing (raster::SetCoalescing()) doesn't apply. Raster::Backend::Native needs
+    // the whole document, so the chunks are concatenated for it (and minified if enabled);
+    // the browser backends read the chunks as they are (raster::SetMinify() is ignored).
+    // The other arguments have the same meaning as for the overload with raster::Callback.
+    inline Request SvgToImage(std::span<const std::string_view> chunks, Callback cb,
+                              void *meta = nullptr, const std::string& format = "image/png",
+                              float quality = 1.0f, float x = 0.0f, float y = 0.0f,
+                              float width = 0.0f, float height = 0.0f, float zoom = 1.0f);
+
+    // Options of the conversion with the compile-time format (see raster::SvgToImage<Format>()).
+    // Fields have the same meaning as the raster::SvgToImage() arguments.
+    // Level is the png level of raster::Encoder::Wasm for this call
+    // (-1 - the level of raster::SetEncoder()).
+    // JS reads the floats from the heap with HEAPF32, so the layout is fixed.
+    struct Options {
+        float quality = 1.0f;
+        float x = 0.0f;
+        float y = 0.0f;
+        float width = 0.0f;
+        float height = 0.0f;
+        float zoom = 1.0f;
+        int level = -1;
+    };
+    static_assert(sizeof(Options) == 6 * sizeof(float) + sizeof(int),
+                  "Unexpected padding [raster::Options]");
+
+    // MIME type of the encoded format (nullptr for raster::Format::RawRgba and Unknown).
+    template<Format F>
+    inline constexpr const char *mime_type = F == Format::Png ? "image/png"
+                                           : F == Format::Jpeg ? "image/jpeg"
+                                           : F == Format::Webp ? "image/webp"
+                                           : nullptr;
+
+    // Asynchronously converts svg to raster image via the browser (C++ facade).
+    // The same as the overload with raster::Callback, but the format is a template argument
+    // (png, jpeg, or webp), and the other arguments are in the options. JS receives
+    // the format code (mapped to the MIME type with a prebuilt table) and the options pointer,
+    // so the call constructs and decodes no strings. E.g.,
+    // raster::SvgToImage<raster::Format::Webp>(svg, cb, {.quality = 0.8f}).
+    // With coalescing (raster::SetCoalescing()), the call falls back to the overload above.
+    template<Format F = Format::Png>
+        requires (mime_type<F> != nullptr)
+    inline Request SvgToImage(std::string_view svg, Callback cb, const Options &opts = {},
+                              void *meta = nullptr);
+
+    // Asynchronously converts svg to raster image via the browser (C++ facade).
+    // The arguments have the same meaning as for the overload with raster::Callback, but the callback
+    // takes ownership of the image buffer, so the image data needn't be copied.
+    // If alloc is specified, the buffer is allocated with it (e.g., in pre-reserved storage).
+    inline Request SvgToImage(std::string_view svg, BufferCallback cb, void *meta = nullptr,
+                              const std::string& format = "image/png", float quality = 1.0f,
+                              float x = 0.0f, float y = 0.0f, float width = 0.0f,
+                              float height = 0.0f, float zoom = 1.0f, Allocator alloc = {});
+
+    // Asynchronously converts svg to raw RGBA pixels via the browser (C++ facade).
+    // The pixels are read from <canvas> with getImageData(), so we skip the image encoding
+    // by the browser and the image decoding by the client (Format::RawRgba).
+    // The arguments have the same meaning as for the overload above.
+    // Note that the pixel buffer is deallocated after the callback returns.
+    // Thus, you should copy the pixels to use them further.
+    inline Request SvgToImage(std::string_view svg, PixelCallback cb, void *meta = nullptr,
+                              float x = 0.0f, float y = 0.0f, float width = 0.0f,
+                              float height = 0.0f, float zoom = 1.0f);
+
+    // Asynchronously converts svg to WebGL texture via the browser (C++ facade).
+    // The image is uploaded with texImage2D() on the JS side, so there is no image export,
+    // no heap allocation, and no decoding by the client. Ctx is the Emscripten WebGL context
+    // that will own the texture (see emscripten_webgl_get_current_context()).
+    // The texture is RGBA with linear filtering and clamp-to-edge wrapping;
+    // the bindings of ctx are restored after the upload.
+    // The other arguments have the same meaning as for raster::SvgToImage().
+    // The texture is always uploaded on the main thread (raster::Backend::Worker is ignored).
+    inline Request SvgToTexture(std::string_view svg, EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx,
+                                TextureCallback cb, void *meta = nullptr,
+                                float x = 0.0f, float y = 0.0f, float width = 0.0f,
+                                float height = 0.0f, float zoom = 1.0f);
+
+    // Tiled output
+
+    // Tile of the tiled conversion (see raster::SvgToTiles()).
+    struct Tile {
+        std::string_view data; // Encoded image or raw RGBA pixels.
+        int col = 0; // Position in the grid.
+        int row = 0;
+        int cols = 0; // Grid size.
+        int rows = 0;
+        int x = 0; // Position in the output image (in pixels).
+        int y = 0;
+        int width = 0;
+        int height = 0;
+        int stride = 0; // Row size for raw pixels (in bytes); 0 for encoded tiles.
+    };
+
+    // Client's callback type for the tiles.
+    // Last is true for the final call; the callback is not called after it.
+    using TileCallback = std::function<void(const Tile &tile, Error err, bool last, void *meta)>;
+
+    // Asynchronously converts svg to raster image split into tiles (C++ facade).
+    // Use it for outputs beyond the browser's canvas limits (e.g., poster prints at high zoom).
+    // The tiles of tile_size x tile_size pixels (smaller at the right/bottom edges) are rendered
+    // one by one on the same canvas by offsetting the image, and each tile is passed
+    // to the callback in row-major order. So the peak memory is bounded by a single tile.
+    // Each tile is encoded with format and quality; an empty format means raw RGBA pixels.
+    // Width, height, and zoom have the same meaning as for raster::SvgToImage().
+    // On failure, the callback is called once with the error and an empty tile (last is true).
+    // Note that the tile data is deallocated after the callback returns.
+    // The tiles are always rendered on the main thread (raster::Backend is ignored).
+    inline Request SvgToTiles(std::string_view svg, int tile_size, TileCallback cb,
+                              void *meta = nullptr, const std::string& format = "image/png",
+                              float quality = 1.0f, float width = 0.0f, float height = 0.0f,
+                              float zoom = 1.0f);
+
+    // Progressive output
+
+    // Low-resolution preview of the progressive conversion (see raster::SvgToProgressive()).
+    struct Preview {
+        float scale = 0.25f; // Zoom of the preview relative to the output zoom.
+        std::string format = "image/jpeg"; // Empty - raw RGBA pixels.
+        float quality = 0.5f;
+        // Outputs with fewer pixels are rendered without the preview.
+        std::size_t min_pixels = 512 * 512;
+    };
+
+    // Image of the progressive conversion: the preview or the full output.
+    struct Frame {
+        std::string_view data; // Encoded image or raw RGBA pixels.
+        int width = 0;
+        int height = 0;
+        int stride = 0; // Row size for raw pixels (in bytes); 0 for encoded images.
+    };
+
+    // Client's callback type for the progressive conversion.
+    // Preliminary is true for the preview, which is followed by the full output.
+    using ProgressiveCallback = std::function<void(const Frame &frame, Error err,
+                                                   bool preliminary, void *meta)>;
+
+    // Asynchronously converts svg to raster image with a preview via the browser (C++ facade).
+    // The svg is loaded once; then the cheap downscaled preview and the full output
+    // are rendered (the preview goes first). The preview is delivered with preliminary = true
+    // unless the full output lands first: then the preview is dropped without reading it.
+    // Preview errors are ignored, and the full output completes the conversion
+    // (the callback is called with preliminary = false exactly once).
+    // The other arguments have the same meaning as for raster::SvgToImage().
+    // Note that the frame data is deallocated after the callback returns.
+    inline Request SvgToProgressive(std::string_view svg, ProgressiveCallback cb,
+                                    void *meta = nullptr, const std::string& format = "image/png",
+                                    float quality = 1.0f, float x = 0.0f, float y = 0.0f,
+                                    float width = 0.0f, float height = 0.0f, float zoom = 1.0f,
+                                    const Preview &preview = {});
+
+    // Multiple outputs
+
+    // Output target of the multi-output conversion.
+    // Fields have the same meaning as the raster::SvgToImage() arguments.
+    // Level is the same as raster::Options::level (used by raster::SvgHandle::Render()).
+    struct Target {
+        std::string format = "image/png";
+        float quality = 1.0f;
+        float x = 0.0f;
+        float y = 0.0f;
+        float width = 0.0f;
+        float height = 0.0f;
+        float zoom = 1.0f;
+        int level = -1;
+    };
+
+    // Output of the multi-output conversion for a single target.
+    struct Result {
+        std::string_view img;
+        Error err = Error::None;
+    };
+
+    // Client's callback type for a single target (idx is the target index).
+    using TargetCallback = std::function<void(std::size_t idx, std::string_view img, Error err,
+                                              void *meta)>;
+
+    // Client's callback type for all targets (results go in the targets order).
+    using TargetsCallback = std::function<void(std::span<const Result> results, void *meta)>;
+
+    // Asynchronously converts svg to many raster images via the browser (C++ facade).
+    // The svg is encoded and loaded to <img> once; then each target is drawn
+    // and exported on the same reused <canvas>. The callback is called once with all outputs,
+    // which are placed in a single heap buffer.
+    // Note that the buffer is deallocated after the callback returns.
+    // Thus, you should copy the image data to use it further.
+    inline void SvgToTargets(std::string_view svg, std::span<const Target> targets,
+                             TargetsCallback cb, void *meta = nullptr);
+
+    // The same as above, but the callback is called per target as soon as the target is ready.
+    inline void SvgToTargets(std::string_view svg, std::span<const Target> targets,
+                             TargetCallback cb, void *meta = nullptr);
+
+    // Handles
+
+    // Svg loaded to <img> once and kept alive on the JS side (see raster::LoadSvg()).
+    // Use it for parameter sweeps and animations (zoom, pan, resize): each Render() call
+    // only redoes drawing and export, without encoding and decoding svg again.
+    // Renders issued before the svg is loaded wait for it; if the svg fails to load,
+    // each render fails with the same error. The handle owns the loaded <img>, which is
+    // released by Release() or the destructor (the pending renders are still completed),
+    // so handles are movable but not copyable.
+    // Renders use the browser backends (raster::Backend::Native falls back to Main).
+    class SvgHandle {
+    public:
+        SvgHandle() = default;
+
+        explicit SvgHandle(const int id) noexcept : id_(id) {}
+
+        SvgHandle(SvgHandle &&other) noexcept : id_(std::exchange(other.id_, 0)) {}
+
+        SvgHandle &operator=(SvgHandle &&other) noexcept {
+            if (this != &other) {
+                Release();
+                id_ = std::exchange(other.id_, 0);
+            }
+            return *this;
+        }
+
+        SvgHandle(const SvgHandle &) = delete;
+        SvgHandle &operator=(const SvgHandle &) = delete;
+
+        ~SvgHandle() { Release(); }
+
+        // Renders svg to raster image (see raster::SvgToImage()).
+        // Target fields have the same meaning as the raster::SvgToImage() arguments.
+        inline Request Render(const Target &target, Callback cb, void *meta = nullptr) const;
+
+        // Renders svg to raw RGBA pixels (the target format and quality are ignored).
+        inline Request Render(const Target &target, PixelCallback cb,
+                              void *meta = nullptr) const;
+
+        // Renders svg to WebGL texture of ctx (see raster::SvgToTexture()).
+        // The target format and quality are ignored.
+        inline Request Render(const Target &target, EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx,
+                              TextureCallback cb, void *meta = nullptr) const;
+
+        // Releases the loaded svg. Renders of the empty handle fail with Error::NoInputData.
+        inline void Release() noexcept;
+
+        int GetId() const noexcept { return id_; }
+        explicit operator bool() const noexcept { return id_ != 0; }
+
+    private:
+        int id_ = 0;
+    };
+
+    // Loads svg to <img> via the browser and returns the handle for repeated renders.
+    // Svg is read before the function returns (see raster::SetMinify() and raster::Input).
+    // The handle is empty if svg is empty.
+    inline SvgHandle LoadSvg(std::string_view svg);
+
+    // Sprite atlas
+
+    // Rect of the icon in the sprite atlas (see raster::BuildAtlas()).
+    struct AtlasRect {
+        int x = 0; // Position in the atlas (in pixels).
+        int y = 0;
+        int width = 0; // Icon size (0 if the icon is not packed).
+        int height = 0;
+        float u0 = 0.0f; // Texture coordinates of the top-left corner (0.0..1.0).
+        float v0 = 0.0f;
+        float u1 = 0.0f; // Texture coordinates of the bottom-right corner.
+        float v1 = 0.0f;
+        Error err = Error::None; // Why the icon is not packed (see raster::BuildAtlas()).
+    };
+
+    // Sprite atlas: all icons packed into a single image.
+    struct Atlas {
+        Pixels pixels; // Raw RGBA pixels (empty for the texture atlas).
+        Texture texture; // WebGL texture (empty for the pixel atlas).
+        int width = 0; // Atlas size in pixels.
+        int height = 0;
+        std::vector<AtlasRect> rects; // Rects of the icons in the order of svgs.
+    };
+
+    // Client's callback type for sprite atlases (see raster::Callback for details).
+    using AtlasCallback = std::function<void(const Atlas &atlas, Error err, void *meta)>;
+
+    // Asynchronously packs svg icons into a single sprite atlas via the browser (C++ facade).
+    // Use it for icon sets: one readback (or upload) and one texture to bind instead of
+    // one per icon. Each svg is loaded to <img> once (all in parallel) and drawn at its own
+    // size * zoom. The icon sizes are rectangle-packed (skyline, bottom-left) into the atlas
+    // up to max_size x max_size pixels with padding pixels between the icons; then all icons
+    // are drawn on a single <canvas>, which is read back as raw RGBA pixels.
+    // Icons that are empty (NoInputData), fail to load (ImgLoadingFailed), or don't fit
+    // (CanvasDrawingFailed) get the empty rects with the error, the others are still packed.
+    // The atlas itself fails only if no icon is packed or <canvas> can't be read.
+    // Note that the pixel buffer is deallocated after the callback returns.
+    // The atlas is always drawn on the main thread (raster::Backend is ignored).
+    inline Request BuildAtlas(std::span<const std::string_view> svgs, int max_size,
+                              AtlasCallback cb, void *meta = nullptr, float zoom = 1.0f,
+                              int padding = 1);
+
+    // The same as above, but the atlas is uploaded to a texture of ctx
+    // (see raster::SvgToTexture()).
+    inline Request BuildAtlas(std::span<const std::string_view> svgs, int max_size,
+                              EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx, AtlasCallback cb,
+                              void *meta = nullptr, float zoom = 1.0f, int padding = 1);
+
+    // Batch
+
+    // Job of the batch conversion.
+    // Fields have the same meaning as the raster::SvgToImage() arguments.
+    // Priority affects the dispatch order: jobs with higher priority are dispatched first,
+    // jobs with equal priority - in FIFO order. Cb is optional.
+    // Level is the same as raster::Options::level, but -1 means the level
+    // at the raster::SvgToImages() call.
+    struct Job {
+        std::string_view svg;
+        Callback cb;
+        void *meta = nullptr;
+        std::string format = "image/png";
+        float quality = 1.0f;
+        float x = 0.0f;
+        float y = 0.0f;
+        float width = 0.0f;
+        float height = 0.0f;
+        float zoom = 1.0f;
+        int priority = 0;
+        int level = -1;
+    };
+
+    // Client's callback type for the whole batch.
+    // The callback receives the number of jobs, the number of failed jobs,
+    // and pointer to the metadata.
+    using BatchCallback = std::function<void(std::size_t total, std::size_t failed, void *meta)>;
+
+    // Asynchronously converts a batch of svgs to raster images via the browser (C++ facade).
+    // At most max_in_flight jobs are processed by the browser simultaneously; the rest
+    // wait in the queue. Thus, the memory usage and the browser decoder load stay bounded.
+    // Job callbacks are called as jobs complete, the batch callback - after the last one.
+    // The jobs are moved into the batch storage allocated once per batch, so dispatching
+    // doesn't allocate. Note that the job svg data is not copied and should remain valid
+    // until the batch callback is called.
+    inline void SvgToImages(std::span<Job> jobs, BatchCallback cb, void *meta = nullptr,
+                            std::size_t max_in_flight = 4);
+
+    // Cache
+
+    namespace aux { struct CacheState; }
+
+    // Counters of raster::Cache.
+    struct CacheStats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+        std::size_t evictions = 0;
+        std::size_t entries = 0; // Current number of cached images.
+        std::size_t bytes = 0; // Current size of cached images.
+    };
+
+    // Content-addressed, memory-bounded cache of rasterized images.
+    // The key is a fast 64-bit hash of the svg bytes (not cryptographic) plus the svg size
+    // and all raster::SvgToImage() arguments except the callback and metadata, plus the png
+    // encoder and its level (see raster::SetEncoder()) at the call.
+    // Entries are evicted in LRU order when the total size of cached images exceeds
+    // the budget (in bytes); images larger than the budget are not cached. Errors are not cached.
+    // On a hit, the callback receives a view into the cache storage, which remains valid
+    // until the callback returns (as for raster::SvgToImage()).
+    // Copies of the cache share the same storage. The cache may be destroyed
+    // while its conversions are in flight.
+    class Cache {
+    public:
+        // Delivery of cache hits.
+        // Sync - the callback is called from Cache::SvgToImage() before it returns;
+        // NextTick - the callback is called asynchronously on the next browser tick.
+        enum class Delivery: int {
+            Sync = 0,
+            NextTick,
+        };
+
+        inline explicit Cache(std::size_t budget, Delivery delivery = Delivery::Sync);
+
+        // The same as raster::SvgToImage(), but consults the cache first.
+        inline void SvgToImage(std::string_view svg, Callback cb, void *meta = nullptr,
+                               const std::string& format = "image/png", float quality = 1.0f,
+                               float x = 0.0f, float y = 0.0f, float width = 0.0f,
+                               float height = 0.0f, float zoom = 1.0f);
+
+        // Sets the budget (in bytes). Evicts the least recently used entries if needed.
+        inline void SetBudget(std::size_t budget);
+
+        // Returns the budget (in bytes).
+        inline std::size_t GetBudget() const;
+
+        // Removes all entries (counters are preserved).
+        inline void Clear();
+
+        // Returns the cache counters.
+        inline CacheStats GetStats() const;
+
+    private:
+        // Shared with the pending conversions, which outlive the cache.
+        std::shared_ptr<aux::CacheState> state_;
+    };
+
+    // Scheduler
+
+    namespace aux { struct SchedulerState; }
+
+    // Counters of raster::Scheduler.
+    struct SchedulerStats {
+        std::size_t submitted = 0;
+        std::size_t deferred = 0; // Conversions queued instead of being started at once.
+        std::size_t completed = 0;
+        std::size_t queued = 0; // Current number of queued conversions.
+        std::size_t in_flight = 0; // Current number of started conversions.
+        std::size_t in_flight_bytes = 0; // Estimated memory of the started conversions.
+        std::size_t peak_bytes = 0; // Maximum of in_flight_bytes.
+    };
+
+    // Priority scheduler of conversions with memory-budget backpressure.
+    // Each in-flight conversion holds the svg data, the decoded image, the canvas,
+    // and the output, so its memory is estimated as width * height * zoom^2 * 4 bytes
+    // (the zero width or height is read from the svg root: width, height, or viewBox).
+    // A conversion is started if its estimate fits the budget along with the in-flight ones
+    // (or nothing is in flight, so oversized conversions still progress); otherwise it waits
+    // in the queue. Queued conversions are started as the in-flight ones complete: higher
+    // priority first, equal priority - in FIFO order. Thus, interactive conversions submitted
+    // with higher priority jump ahead of the queued background work.
+    class Scheduler {
+    public:
+        inline explicit Scheduler(std::size_t budget = 64 * 1024 * 1024);
+
+        // The same as raster::SvgToImage(), but with the priority (higher first).
+        // The svg is copied if the conversion is queued, so it may be released
+        // after the function returns.
+        inline void SvgToImage(int priority, std::string_view svg, Callback cb,
+                               void *meta = nullptr, const std::string& format = "image/png",
+                               float quality = 1.0f, float x = 0.0f, float y = 0.0f,
+                               float width = 0.0f, float height = 0.0f, float zoom = 1.0f);
+
+        // Sets the budget (in bytes). Starts the queued conversions if it allows.
+        inline void SetBudget(std::size_t budget);
+
+        // Returns the budget (in bytes).
+        inline std::size_t GetBudget() const;
+
+        // Returns the scheduler counters.
+        inline SchedulerStats GetStats() const;
+
+    private:
+        // Shared with the pending conversions, which outlive the scheduler.
+        std::shared_ptr<aux::SchedulerState> state_;
+    };
+
+    // Stats
+
+    // Stages of the conversion pipeline (see raster::GetStats()).
+    // Encode - encoding svg as data uri (or wrapping it in a blob);
+    // Load - loading svg to <img>;
+    // Draw - drawing <img> on <canvas> (for the Worker backend - decoding <img> to ImageBitmap);
+    // Export - exporting the image with toBlob() (for the Worker backend - the worker round trip
+    // including drawing and encoding; raster::Encoder::Wasm adds the png encoding on the heap);
+    // Read - reading the blob with arrayBuffer();
+    // Copy - copying the image to the WASM heap;
+    // Total - from the conversion start to the callback.
+    enum class Stage: int {
+        Encode = 0,
+        Load,
+        Draw,
+        Export,
+        Read,
+        Copy,
+        Total,
+    };
+
+    inline constexpr std::size_t stage_count = 7;
+
+    // Histogram of latencies (in milliseconds).
+    // Buckets are logarithmic: the bucket i holds latencies up to bound(i) = 2^i / 16 ms
+    // (the last bucket holds the rest). Thus, percentiles are approximated
+    // by the bucket bounds (clamped to max).
+    struct Histogram {
+        static constexpr std::size_t bucket_count = 20;
+
+        std::array<std::uint64_t, bucket_count> buckets{};
+        std::uint64_t count = 0;
+        double sum = 0.0;
+        double min = 0.0;
+        double max = 0.0;
+
+        // Returns the upper bound of the bucket (in milliseconds).
+        static constexpr double Bound(const std::size_t i) {
+            return static_cast<double>(std::uint64_t{1} << i) / 16.0;
+        }
+
+        void Add(const double ms) {
+            std::size_t i = 0;
+            while (i + 1 < bucket_count and ms > Bound(i)) ++i;
+            ++buckets[i];
+            min = count == 0 ? ms : std::min(min, ms);
+            max = count == 0 ? ms : std::max(max, ms);
+            sum += ms;
+            ++count;
+        }
+
+        double Mean() const { return count == 0 ? 0.0 : sum / static_cast<double>(count); }
+
+        // Returns the approximate percentile (p = 0.0..1.0).
+        double Percentile(const double p) const {
+            if (count == 0) return 0.0;
+            const auto rank = static_cast<std::uint64_t>(p * static_cast<double>(count - 1)) + 1;
+            std::uint64_t seen = 0;
+            for (std::size_t i = 0; i < bucket_count; ++i) {
+                seen += buckets[i];
+                if (seen >= rank) return std::min(Bound(i), max);
+            }
+            return max;
+        }
+    };
+
+    // Stage timings of a single conversion.
+    struct Sample {
+        std::array<double, stage_count> ms{}; // Stage latencies; negative if the stage was skipped.
+        std::size_t input_bytes = 0; // Svg size.
+        std::size_t output_bytes = 0; // Image size (0 for errors and textures).
+        Error err = Error::None;
+    };
+
+    // Aggregated stats of the conversions.
+    struct Stats {
+        std::array<Histogram, stage_count> stages;
+        std::uint64_t conversions = 0;
+        std::uint64_t failures = 0;
+        std::uint64_t input_bytes = 0;
+        std::uint64_t output_bytes = 0;
+
+        const Histogram &operator[](const Stage stage) const {
+            return stages[static_cast<std::size_t>(stage)];
+        }
+    };
+
+    // Client's callback type for the raw samples (e.g., for telemetry).
+    using StatsSink = std::function<void(const Sample &sample)>;
+
+    // Enables/disables stats collection for the subsequent conversions (disabled by default).
+    // Stats are collected with performance.now() for raster::SvgToImage(), raster::SvgToTexture(),
+    // and raster::SvgToImages(). The sink (if any) receives every sample before the client's
+    // callback is called.
+    inline void SetStats(bool enabled, StatsSink sink = nullptr);
+
+    // Returns the aggregated stats.
+    inline const Stats &GetStats();
+
+    // Resets the aggregated stats.
+    inline void ResetStats();
+
+    // Coroutines
+
+    // Minimal substitute for std::expected<T, Error> (C++23).
+    // Holds either the value or the error code (not Error::None).
+    template<class T>
+    class Expected {
+    public:
+        Expected(T value) : value_(std::move(value)) {}
+
+        Expected(const Error err) : err_(err) {
+            assert(err != Error::None && "Expected error code [raster::Expected]");
+        }
+
+        bool has_value() const noexcept { return err_ == Error::None; }
+        explicit operator bool() const noexcept { return has_value(); }
+        Error error() const noexcept { return err_; }
+
+        T &value() & {
+            assert(has_value() && "No value [raster::Expected]");
+            return value_;
+        }
+
+        const T &value() const & {
+            assert(has_value() && "No value [raster::Expected]");
+            return value_;
+        }
+
+        T &&value() && {
+            assert(has_value() && "No value [raster::Expected]");
+            return std::move(value_);
+        }
+
+        T &operator*() & { return value(); }
+        const T &operator*() const & { return value(); }
+        T &&operator*() && { return std::move(*this).value(); }
+        T *operator->() { return &value(); }
+        const T *operator->() const { return &value(); }
+
+    private:
+        T value_{};
+        Error err_ = Error::None;
+    };
+
+    namespace aux {
+        // Completion state of the awaitable conversion (see aux::ExecAsyncCb()).
+        // If pending is not null, the conversion is a part of raster::WhenAll(),
+        // and the handle is resumed by the last completed conversion.
+        struct AsyncState {
+            ImageBuffer img;
+            Error err = Error::None;
+            std::coroutine_handle<> handle;
+            std::size_t *pending = nullptr;
+        };
+    }
+
+    // Awaitable conversion (see raster::SvgToImageAsync()).
+    // The conversion starts when awaited; the awaiting coroutine is resumed directly from
+    // the completion call, and the completion state is stored in the awaitable itself
+    // (i.e., in the coroutine frame), so a hop doesn't allocate.
+    // The awaitable may be moved only before it is awaited.
+    // Level is the same as raster::Options::level (raster::SvgToImageAsync() passes
+    // the current level, so the deferred start doesn't depend on raster::SetEncoder()).
+    class ImageAwaitable {
+    public:
+        ImageAwaitable(const std::string_view svg, std::string format, const float quality,
+                       const float x, const float y, const float width, const float height,
+                       const float zoom, const int level = -1)
+            : svg_(svg), format_(std::move(format)), quality_(quality),
+              x_(x), y_(y), width_(width), height_(height), zoom_(zoom), level_(level) {
+            assert(width >= 0 and height >= 0 and zoom > 0
+                   && "Wrong arguments [raster::SvgToImageAsync()]");
+        }
+
+        ImageAwaitable(ImageAwaitable &&) = default;
+        ImageAwaitable &operator=(ImageAwaitable &&) = default;
+
+        // No input data means the immediate completion with Error::NoInputData.
+        bool await_ready() const noexcept { return svg_.empty() or svg_[0] == '\0'; }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            state_.handle = handle;
+            Start();
+        }
+
+        Expected<ImageBuffer> await_resume() {
+            if (await_ready()) return Error::NoInputData;
+            if (state_.err != Error::None) return state_.err;
+            return std::move(state_.img);
+        }
+
+    private:
+        friend class WhenAllAwaitable;
+
+        // Starts the conversion. The completion may happen before the call returns.
+        inline void Start();
+
+        std::string_view svg_;
+        std::string format_;
+        float quality_;
+        float x_, y_, width_, height_, zoom_;
+        int level_;
+        aux::AsyncState state_;
+    };
+
+    // Awaitable group of conversions (see raster::WhenAll()).
+    // All conversions start when awaited; the awaiting coroutine is resumed once
+    // after the last of them is completed.
+    class WhenAllAwaitable {
+    public:
+        explicit WhenAllAwaitable(std::vector<ImageAwaitable> ops) : ops_(std::move(ops)) {}
+
+        bool await_ready() const noexcept { return ops_.empty(); }
+
+        inline bool await_suspend(std::coroutine_handle<> handle);
+
+        inline std::vector<Expected<ImageBuffer>> await_resume();
+
+    private:
+        std::vector<ImageAwaitable> ops_;
+        std::size_t pending_ = 0;
+    };
+
+    // Fire-and-forget coroutine type for the code awaiting conversions.
+    // The coroutine starts eagerly and destroys itself on completion.
+    // Unhandled exceptions terminate the program.
+    struct Task {
+        struct promise_type {
+            Task get_return_object() noexcept { return {}; }
+            std::suspend_never initial_suspend() noexcept { return {}; }
+            std::suspend_never final_suspend() noexcept { return {}; }
+            void return_void() noexcept {}
+            void unhandled_exception() noexcept { std::terminate(); }
+        };
+    };
+
+    // Asynchronously converts svg to raster image via the browser (C++ facade).
+    // The awaitable version of raster::SvgToImage() with raster::BufferCallback:
+    // co_await yields the owning image buffer or the error code.
+    // The arguments have the same meaning as for raster::SvgToImage().
+    // The svg data should remain valid until the awaitable is awaited.
+    // Usage: auto img = co_await raster::SvgToImageAsync(svg, "image/webp");
+    inline ImageAwaitable SvgToImageAsync(std::string_view svg,
+                                          std::string format = "image/png", float quality = 1.0f,
+                                          float x = 0.0f, float y = 0.0f, float width = 0.0f,
+                                          float height = 0.0f, float zoom = 1.0f);
+
+    // Returns the awaitable, which runs all conversions concurrently.
+    // co_await yields the results in the order of the conversions.
+    // Usage: auto imgs = co_await raster::WhenAll(std::move(ops));
+    inline WhenAllAwaitable WhenAll(std::vector<ImageAwaitable> ops);
+
+    // Settings
+
+    // Sets the backend for the subsequent raster::SvgToImage() calls.
+    // Already started conversions are not affected.
+    inline void SetBackend(Backend backend);
+
+    // Returns the current backend.
+    inline Backend GetBackend();
+
+    // Stats of the rasterization worker (see raster::GetWorkerStats()).
+    struct WorkerStats {
+        std::size_t jobs = 0; // Completed jobs.
+        std::size_t steals = 0; // Jobs stolen from the other workers' deques.
+        std::size_t queued = 0; // Jobs in the deque, including the running one.
+        double busy_ms = 0.0; // Time spent on jobs.
+        double utilization = 0.0; // Busy time / worker lifetime (0.0..1.0).
+    };
+
+    // Configures the worker pool of raster::Backend::Worker.
+    // Size is the number of workers (0 - navigator.hardwareConcurrency, the default).
+    // Each worker has its own OffscreenCanvas and its own deque of jobs (up to queue_depth);
+    // new jobs are distributed round-robin, and an idle worker with the empty deque steals
+    // from the longest one. If all deques are full, the job is rendered on the main thread.
+    // The pool may be resized at any time: retired workers finish their current jobs.
+    // Note that raster::SvgToImages() keeps up to max_in_flight jobs in the pool, so it should
+    // be at least the pool size to keep all workers busy.
+    // If the module is built with shared memory (-pthread or -sSHARED_MEMORY), each worker
+    // reserves an arena of arena_size bytes in the WASM heap and writes the outputs that fit
+    // into it directly (without the transfer and the heap copy). Single-output conversions
+    // get the output in place; the arena is reused after the callback returns.
+    // The arena size applies to the workers created after the call.
+    inline void SetWorkerPool(std::size_t size = 0, std::size_t queue_depth = 64,
+                              std::size_t arena_size = 8 * 1024 * 1024);
+
+    // Returns the stats of the alive workers (empty if the pool is not created yet).
+    inline std::vector<WorkerStats> GetWorkerStats();
+
+    // Stats of the main-thread canvas pool (see raster::SetCanvasPool()).
+    struct CanvasPoolStats {
+        std::size_t hits = 0; // Canvases reused from the pool.
+        std::size_t misses = 0; // Canvases created because the pool had none of the size.
+        std::size_t drops = 0; // Canvases released because the pool was full.
+        std::size_t pooled = 0; // Free canvases in the pool now.
+    };
+
+    // Sets the capacity of the pool of free canvases drawn on the main thread (16 by default,
+    // 0 - no pooling). Canvases are keyed by the output: raw outputs (pixels, the in-WASM
+    // encoder) get their 2D contexts created with willReadFrequently, so getImageData() reads
+    // the CPU-backed canvas. Raw canvases are sized up to powers of two and read back
+    // by the output rect; the encoded ones (toBlob() and textures take the whole canvas)
+    // are keyed by the exact size. Pooled canvases are never resized (that reallocates
+    // the backing store): a canvas is cleared on reuse and returned to the pool
+    // right after the synchronous snapshot.
+    // Workers keep their own OffscreenCanvas (see raster::SetWorkerPool()).
+    inline void SetCanvasPool(std::size_t capacity = 16);
+
+    // Returns the stats of the canvas pool.
+    inline CanvasPoolStats GetCanvasPoolStats();
+
+    // Stats of the output arena (see raster::SetOutputArena()).
+    struct OutputArenaStats {
+        std::size_t hits = 0; // Outputs placed in the arena.
+        std::size_t fallbacks = 0; // Outputs allocated with malloc (no arena or it was full).
+        std::size_t high_water = 0; // Maximum arena usage (in bytes).
+        std::size_t capacity = 0; // Current arena size (0 - no arena).
+    };
+
+    // Reserves the ring arena of the capacity in the WASM heap for the outputs that are passed
+    // to the callbacks and deallocated after they return (0 - no arena, the default).
+    // Call it at startup: with ALLOW_MEMORY_GROWTH, the bursts of large outputs then neither
+    // grow nor fragment the heap. Outputs are reclaimed in the completion order;
+    // an output that doesn't fit falls back to malloc. Owning buffers (raster::ImageBuffer)
+    // are never placed in the arena. Replacing the arena frees the previous one
+    // as soon as its last output is released.
+    inline void SetOutputArena(std::size_t capacity);
+
+    // Returns the stats of the output arena.
+    inline OutputArenaStats GetOutputArenaStats();
+
+    // Enables/disables the deferred completions (disabled by default).
+    // When enabled, the finished conversions don't call back at once: their delivery
+    // (the heap copy, the texture upload, and the callback) is queued until
+    // raster::PumpCompletions() is called, e.g., from the emscripten_set_main_loop() frame.
+    // Thus, a burst of finished conversions doesn't run all callbacks within one frame.
+    // Synchronous completions (Error::NoInputData, raster::Backend::Native, cache hits)
+    // and cancellation (raster::Request::Cancel()) still call back before the function returns;
+    // a queued delivery of the cancelled conversion is dropped.
+    // Disabling runs the queued completions before the function returns.
+    inline void SetDeferredCompletions(bool enabled);
+
+    // Runs the queued completions in order until budget_ms milliseconds are spent
+    // (at least one, so the queue always drains). Returns the number of completions run.
+    inline std::size_t PumpCompletions(double budget_ms);
+
+    // Returns the number of queued completions.
+    inline std::size_t GetQueuedCompletions();
+
+    // Interface of the in-WASM svg engine for raster::Backend::Native.
+    // Implement it with a compiled-in engine (e.g., resvg or plutovg) and register it
+    // with raster::SetRasterizer().
+    class Rasterizer {
+    public:
+        virtual ~Rasterizer() = default;
+
+        // Rasterizes svg to non-premultiplied RGBA pixels (stride is width * 4).
+        // The arguments have the same meaning as for raster::SvgToImage(): the output size
+        // is (width or the svg width) * zoom by (height or the svg height) * zoom, and the image
+        // is drawn at (x, y). On success, the rasterizer fills pixels and sets the output size.
+        virtual Error Rasterize(std::string_view svg, float x, float y, float width, float height,
+                                float zoom, std::vector<std::uint8_t> &pixels,
+                                int &out_width, int &out_height) = 0;
+    };
+
+    // Registers the rasterizer of raster::Backend::Native (nullptr unregisters it).
+    inline void SetRasterizer(std::shared_ptr<Rasterizer> rasterizer);
+
+    // Returns the registered rasterizer (or nullptr).
+    inline const std::shared_ptr<Rasterizer> &GetRasterizer();
+
+    // Sets the input mode for the subsequent raster::SvgToImage() calls.
+    inline void SetInput(Input input);
+
+    // Returns the current input mode.
+    inline Input GetInput();
+
+    // Sets the png encoder and its level for the subsequent raster::SvgToImage() calls.
+    // The level is the default of the per-call level (raster::Options::level, Job::level,
+    // and Target::level), which is the way to mix fast previews and compact archival images.
+    // Conversions capture the level when called (batch jobs, scheduled, and awaitable
+    // conversions - when submitted), so the later calls don't affect them.
+    // Level is the speed/size trade-off of raster::Encoder::Wasm (as the zlib levels):
+    // 0 - no compression (the fastest, the largest), 1..3 - fast (the Sub row filter and
+    // short match chains), 4..9 - compact (the adaptive row filter and longer match chains).
+    // raster::Backend::Native always encodes png in C++: at the level with raster::Encoder::Wasm,
+    // and at the fast level 1 with raster::Encoder::Browser (see aux::native_png_level).
+    inline void SetEncoder(Encoder encoder, int level = 6);
+
+    // Returns the current png encoder.
+    inline Encoder GetEncoder();
+
+    // Returns the current png encoder level.
+    inline int GetEncoderLevel();
+
+    // Enables/disables coalescing of identical in-flight conversions (disabled by default).
+    // If enabled, raster::SvgToImage() with the same svg bytes and arguments as a pending
+    // conversion doesn't start a new one: its callback is attached to the pending conversion.
+    // All attached callbacks are called in the order of attachment with the same image buffer.
+    // Requests are identified like raster::Cache keys (the svg hash, size, arguments,
+    // the png encoder, and the per-call level, e.g., raster::Options::level).
+    // Unlike raster::Cache, completed results are not stored.
+    inline void SetCoalescing(bool enabled);
+
+    // Returns true if coalescing is enabled.
+    inline bool GetCoalescing();
+
+    // Enables/disables minification of svg before the conversion (disabled by default).
+    // See raster::MinifySvg(). It applies to all backends and inputs; with raster::Input::Uri,
+    // svg is minified and percent-encoded in WASM, so JS receives the small ready uri.
+    inline void SetMinify(bool enabled);
+
+    // Returns true if minification is enabled.
+    inline bool GetMinify();
 
     // Helpers
 
@@ -83,14 +1196,46 @@ namespace raster {
     // Returns the C-string representation of an image format.
     inline const char *ToCStr(Format fmt);
 
+    // Returns the C-string representation of a backend.
+    inline const char *ToCStr(Backend backend);
+
+    // Returns the C-string representation of an input mode.
+    inline const char *ToCStr(Input input);
+
+    // Returns the C-string representation of a pipeline stage.
+    inline const char *ToCStr(Stage stage);
+
+    // Returns svg without comments, <metadata>, editor data (elements and attributes
+    // in the Inkscape, Sodipodi, Illustrator, Sketch, and Affinity namespaces),
+    // and redundant whitespace. Whitespace inside <text>, <style>, <script>,
+    // and <foreignObject> is kept as is. Svg is processed in a single pass without parsing
+    // into a tree, so the malformed markup is passed through rather than fixed.
+    inline std::string MinifySvg(std::string_view svg);
+
     // Returns image header as a hex substring.
     // Pos argument specifies header start, n - header length.
     // Output formatting example: "89 50 4E 47 0D 0A 1A 0A" (png header).
     inline std::string GetImageHeader(std::string_view img, std::size_t pos = 0,
                                       std::size_t n = 8);
 
+    // Metadata of the encoded image (see raster::GetImageInfo()).
+    struct ImageInfo {
+        Format format = Format::Unknown;
+        int width = 0; // 0 if unknown.
+        int height = 0; // 0 if unknown.
+        int bit_depth = 0; // Bits per channel; 0 if unknown.
+        bool alpha = false; // True if the image has an alpha channel.
+    };
+
+    // Parses the image format and metadata from the header without decoding the image
+    // (e.g., to size textures and buffers in advance). Compares raw bytes and doesn't allocate.
+    // Png metadata is read from IHDR, jpeg - from the first SOFn segment,
+    // webp - from the VP8 (lossy), VP8L (lossless), or VP8X (extended) chunk.
+    // Fields that can't be parsed (e.g., for the truncated image) keep the default values.
+    constexpr ImageInfo GetImageInfo(std::string_view img) noexcept;
+
     // Deduces the image format by the header.
-    inline Format GetImageFormat(std::string_view img);
+    constexpr Format GetImageFormat(std::string_view img) noexcept;
 }
 
 // ============================================================================
@@ -121,143 +1266,4804 @@ namespace raster::aux {
     // To avoid a dangling pointer, we should guarantee that the callback object
     // remains until the aux::ExecCb() call. To achieve that, we copy the callback
     // to the dynamic memory in raster::SvgToImage() and free it in aux::ExecCb().
+    // The callback is called in place (without copying).
     using PCallback = const Callback * const;
 
-    // Converts svg to raster image via the browser (JS implementation).
-    EM_JS_INLINE(void, SvgToImage, (const char* data, std::size_t size, PCallback pcb,
-                                    void* meta, const char* format, float quality,
-                                    float x, float y, float width, float height,
-                                    float zoom), {
-        // -------------------------------------------------------------------
-        // Constants
-        // -------------------------------------------------------------------
+    // Pointer to the pixel callback's copy (see aux::PCallback).
+    using PPixelCallback = const PixelCallback * const;
 
-        const RasterError = {
-            None: 0,
-            NoInputData: 1,
-            UriEncodingFailed: 2,
-            ImgLoadingFailed: 3,
-            CanvasDrawingFailed: 4,
-            BlobExportFailed: 5,
-        };
+    // Pointer to the texture callback's copy (see aux::PCallback).
+    using PTextureCallback = const TextureCallback * const;
 
-        // -------------------------------------------------------------------
-        // Helpers
+    // Pointer to the tile callback's copy (see aux::PCallback).
+    using PTileCallback = const TileCallback * const;
+
+    // Pointer to the progressive callback's copy (see aux::PCallback).
+    using PProgressiveCallback = const ProgressiveCallback * const;
+
+    // Pointer to the target callback's copy (see aux::PCallback).
+    using PTargetCallback = const TargetCallback * const;
+
+    // Pointer to the targets callback's copy (see aux::PCallback).
+    using PTargetsCallback = const TargetsCallback * const;
+
+    // Target passed to JS.
+    // JS reads targets from the heap with HEAPU32/HEAPF32, so the layout is fixed:
+    // format pointer followed by 6 floats (28 bytes for wasm32).
+    struct TargetDesc {
+        const char *format;
+        float quality, x, y, width, height, zoom;
+    };
+    static_assert(sizeof(TargetDesc) == sizeof(const char *) + 6 * sizeof(float),
+                  "Unexpected padding [raster::aux::TargetDesc]");
+
+    // Svg passed to JS (see aux::BuildAtlas()).
+    // JS reads svgs from the heap with HEAPU32, so the layout is fixed (8 bytes for wasm32).
+    struct SvgDesc {
+        const char *data;
+        std::size_t size;
+    };
+    static_assert(sizeof(SvgDesc) == sizeof(const char *) + sizeof(std::size_t),
+                  "Unexpected padding [raster::aux::SvgDesc]");
+
+    // Pending sprite atlas request (see raster::BuildAtlas()).
+    struct AtlasRequest {
+        AtlasCallback cb;
+        Atlas atlas; // Rects are filled by aux::PackAtlas().
+        int max_size = 0;
+        int padding = 0;
+    };
+
+    // Pointer to the atlas request (see aux::PCallback).
+    using PAtlasRequest = AtlasRequest * const;
+
+    // Pending-request slot with the type-erased callable.
+    // Invoke calls the callable stored in place and destroys it.
+    struct Slot {
+        alignas(std::max_align_t) std::byte storage[SVG2IMG_SLOT_SIZE];
+        void (*invoke)(Slot &slot, std::string_view img, Error err, void *meta) = nullptr;
+        std::uint32_t next_free = 0;
+    };
+
+    // True if the callable may be stored in the slot.
+    template<class Fn>
+    inline constexpr bool fits_slot = sizeof(Fn) <= SVG2IMG_SLOT_SIZE
+                                      and alignof(Fn) <= alignof(std::max_align_t);
+
+    // Invokes the callable of type Fn stored in the slot and destroys it.
+    template<class Fn>
+    inline void InvokeSlot(Slot &slot, const std::string_view img, const Error err, void *meta) {
+        Fn &fn = *std::launder(reinterpret_cast<Fn *>(slot.storage));
+        fn(img, err, meta);
+        fn.~Fn();
+    }
+
+    // Fixed-size pool of the pending-request slots.
+    // The slot index (not a pointer) is passed to JS and back to aux::ExecSlotCb().
+    class SlotPool {
+    public:
+        static constexpr std::uint32_t npos = SVG2IMG_SLOT_COUNT;
+
+        SlotPool() {
+            for (std::uint32_t i = 0; i < npos; ++i) slots_[i].next_free = i + 1;
+        }
+
+        // Returns the free slot index or npos if all slots are busy.
+        std::uint32_t Acquire() {
+            const std::uint32_t idx = free_;
+            if (idx != npos) free_ = slots_[idx].next_free;
+            return idx;
+        }
+
+        void Release(const std::uint32_t idx) {
+            slots_[idx].invoke = nullptr;
+            slots_[idx].next_free = free_;
+            free_ = idx;
+        }
+
+        Slot &operator[](const std::uint32_t idx) { return slots_[idx]; }
+
+    private:
+        std::array<Slot, SVG2IMG_SLOT_COUNT> slots_;
+        std::uint32_t free_ = 0;
+    };
+
+    inline SlotPool slots;
+
+    // Pending request with the owning buffer (see raster::BufferCallback).
+    struct BufferRequest {
+        BufferCallback cb;
+        Allocator alloc;
+        bool custom = false; // The buffer was allocated by alloc (not by malloc).
+    };
+
+    // Pointer to the buffer request (see aux::PCallback).
+    using PBufferRequest = BufferRequest * const;
+
+    // Possible outputs of aux::SvgToImage().
+    enum class Output: int {
+        Encoded = 0, // Png/jpeg/webp blob (aux::PCallback).
+        Pixels, // Raw RGBA pixels (aux::PPixelCallback).
+        Texture, // WebGL texture (aux::PTextureCallback).
+        Batch, // Png/jpeg/webp blob of the batch job (aux::Batch *, meta is the job index).
+        Buffer, // Png/jpeg/webp blob in the owning buffer (aux::PBufferRequest).
+        Slot, // Png/jpeg/webp blob for the pending-request slot (pcb is the slot index).
+        Async, // Png/jpeg/webp blob in the owning buffer (aux::AsyncState *).
+        Tiles, // Png/jpeg/webp blob or raw RGBA pixels per tile (aux::PTileCallback).
+        Encode, // Raw RGBA pixels to encode in WASM (see aux::EncodeOutput()).
+        Atlas, // Raw RGBA pixels or texture of the sprite atlas (aux::PAtlasRequest).
+        Progressive, // Png/jpeg/webp blob after the preview (aux::PProgressiveCallback).
+    };
+
+    // Output code of raster::Encoder::Wasm: Output::Encode with the wrapped output
+    // (Encoded, Batch, Buffer, Slot, or Async) and the png level in the upper bits.
+    // JS unpacks the code (see track()) and passes both back to aux::ExecEncodeCb()
+    // with the pcb of the wrapped output, so the request needs no encode state.
+    constexpr int EncodeOutput(const Output wrapped, const int level) {
+        return static_cast<int>(Output::Encode) | static_cast<int>(wrapped) << 8 | level << 16;
+    }
+    static_assert((EncodeOutput(Output::Slot, 9) & 0xFF) == static_cast<int>(Output::Encode)
+                  and (EncodeOutput(Output::Slot, 9) >> 8 & 0xFF) == static_cast<int>(Output::Slot)
+                  and EncodeOutput(Output::Slot, 9) >> 16 == 9,
+                  "Wrong output code [raster::aux::EncodeOutput()]");
+
+    // State of the batch conversion (see raster::SvgToImages()).
+    // Allocated once per batch and deleted after the batch callback returns.
+    struct Batch {
+        std::vector<Job> jobs;
+        std::vector<std::size_t> queue; // Job indices in the dispatch order.
+        std::size_t next = 0; // Position of the next job in the queue.
+        std::size_t in_flight = 0;
+        std::size_t done = 0;
+        std::size_t failed = 0;
+        std::size_t max_in_flight = 1;
+        BatchCallback cb;
+        void *meta = nullptr;
+        bool dispatching = false; // Guards Dispatch() from the reentrant calls.
+    };
+
+    // Dispatches queued jobs while the in-flight limit allows.
+    // Finishes the batch if all jobs are done.
+    inline void Dispatch(Batch *batch);
+
+    // Completes the batch job and dispatches the next ones.
+    inline void Complete(Batch *batch, std::size_t idx, std::string_view img, Error err);
+
+    // Current backend (see raster::SetBackend()).
+    inline Backend backend = Backend::SVG2IMG_DEFAULT_BACKEND;
+
+    // Rasterizer of the native backend (see raster::SetRasterizer()).
+    inline std::shared_ptr<Rasterizer> rasterizer;
+
+    // Current input mode (see raster::SetInput()).
+    inline Input input = Input::DataUri;
+
+    // Coalescing flag (see raster::SetCoalescing()).
+    inline bool coalescing = false;
+
+    // Minification flag (see raster::SetMinify()).
+    inline bool minify = false;
+
+    // Png encoder and its level (see raster::SetEncoder()).
+    inline Encoder encoder = Encoder::Browser;
+    inline int encoder_level = 6;
+
+    // Png level of raster::Backend::Native with raster::Encoder::Browser. There is no browser
+    // encoder to defer to, so it is the fast level (as toBlob() is), not the stored blocks.
+    inline constexpr int native_png_level = 1;
+
+    // Returns the png level of the call (level < 0 - the level of raster::SetEncoder()).
+    inline int EncoderLevel(const int level) {
+        return std::clamp(level < 0 ? encoder_level : level, 0, 9);
+    }
+
+    // Aggregated stats and the sink (see raster::SetStats()).
+    inline bool stats_enabled = false;
+    inline Stats stats;
+    inline StatsSink stats_sink;
+
+    // Installs the JS runtime of the library as Module.svg2img.
+    // The runtime holds the rasterization pipeline and the state shared between
+    // the calls (e.g., the rasterization worker). Repeated calls do nothing.
+    EM_JS_INLINE(void, InstallRuntime, (), {
+        if (Module.svg2img) { return; }
+
+        // -------------------------------------------------------------------
+        // Constants
         // -------------------------------------------------------------------
 
-        // Signals the client about an error.
-        function failed(err) {
-            Module.ccall("ExecCb",
+        const RasterError = {
+            None: 0,
+            NoInputData: 1,
+            UriEncodingFailed: 2,
+            ImgLoadingFailed: 3,
+            CanvasDrawingFailed: 4,
+            BlobExportFailed: 5,
+            TextureUploadFailed: 6,
+            Cancelled: 7,
+            Timeout: 8,
+            NoRasterizer: 9,
+        };
+
+        const RasterBackend = {
+            Main: 0,
+            Worker: 1,
+            Native: 2,
+        };
+
+        const RasterInput = {
+            DataUri: 0,
+            Blob: 1,
+            Uri: 2,
+        };
+
+        // MIME types by raster::Format (see raster::SvgToImage<Format>()).
+        const RasterMime = ["image/png", "image/jpeg", "image/webp"];
+
+        const RasterOutput = {
+            Encoded: 0,
+            Pixels: 1,
+            Texture: 2,
+            Batch: 3,
+            Buffer: 4,
+            Slot: 5,
+            Async: 6,
+            Tiles: 7,
+            Encode: 8,
+            Atlas: 9,
+            Progressive: 10,
+        };
+
+        // -------------------------------------------------------------------
+        // Helpers
+        // -------------------------------------------------------------------
+
+        // Releases the request resources.
+        function release(req) {
+            if (req.url) {
+                URL.revokeObjectURL(req.url);
+                req.url = null;
+            }
+            if (req.timer) {
+                clearTimeout(req.timer);
+                req.timer = null;
+            }
+            if (req.id) { requests.delete(req.id); }
+            req.img = null;
+        }
+
+        // Pending requests (id -> req) that may be cancelled (see raster::Request).
+        let requests = new Map();
+        let next_request_id = 1;
+
+        // Registers the request as pending and returns its id.
+        function track(req) {
+            if ((req.output & 0xFF) == RasterOutput.Encode) { // see aux::EncodeOutput()
+                req.wrapped = (req.output >> 8) & 0xFF;
+                req.level = req.output >> 16;
+                req.output = RasterOutput.Encode;
+            }
+            req.id = next_request_id++;
+            requests.set(req.id, req);
+            return req.id;
+        }
+
+        // Completes the pending request with the error code.
+        // The <img> handlers are detached, and the next stages see req.done and skip the work.
+        function cancel(id, err) {
+            const req = requests.get(id);
+            if (!req) { return; }
+            if (req.img) {
+                req.img.onload = null;
+                req.img.onerror = null;
+                req.img.error = null;
+                req.img.src = "";
+            }
+            failed(req, err);
+        }
+
+        // Cancels the pending request with RasterError.Timeout in ms milliseconds.
+        function setRequestTimeout(id, ms) {
+            const req = requests.get(id);
+            if (!req) { return; }
+            if (req.timer) { clearTimeout(req.timer); }
+            req.timer = setTimeout(() => { cancel(id, RasterError.Timeout); }, ms);
+        }
+
+        // Collects stats of the conversion (see raster::GetStats()).
+        let stats = false;
+
+        // Reports the stage timings of the completed request to C++.
+        // Skipped stages are reported as -1.
+        function report(req, size, err) {
+            const times = takeTimes(req);
+            if (!times) { return; }
+            Module.ccall("RecordSample",
+                         "v", ["number", "number", "number", "number", "number", "number",
+                               "number", "number", "number", "number"],
+                         times.concat([req.size, size, err]));
+        }
+
+        // Takes the stage timings of the request in the order of raster::Stage
+        // (-1 for the skipped stages), or returns null if the request isn't measured.
+        function takeTimes(req) {
+            const t = req.t;
+            if (!t) { return null; }
+            req.t = null;
+            function ms(val) { return val === undefined ? -1 : val; }
+            return [ms(t.encode), ms(t.load), ms(t.draw), ms(t.export), ms(t.read),
+                    ms(t.copy), performance.now() - t.start];
+        }
+
+        // Runs fn, which calls the client's callback. If it throws, the callback
+        // seems broken, so we just alert: the exception must not break the pipeline stage
+        // (e.g., skip freeing the output) or the queued deliveries (see pumpCompletions()).
+        // Every call of the client's callback goes through here exactly once.
+        function guarded(fn) {
+            try {
+                fn();
+            } catch(e) {
+                alert("svg2img: Callback error: " + e.toString());
+            }
+        }
+
+        // Executes the client's callback.
+        // The request is completed, so we also release its resources.
+        // Width and height are used only for raw pixels and textures.
+        // For textures, on_heap is the texture name.
+        // Repeated calls (e.g., the stage completed after cancellation) do nothing.
+        function execCb(req, on_heap, size, err, width, height) {
+            if (req.done) { return; }
+            req.done = true;
+            if (req.output != RasterOutput.Encode) { report(req, size, err); } // see below
+            release(req);
+            if (req.output == RasterOutput.Pixels) {
+                Module.ccall("ExecPixelCb",
+                             "v", ["number", "number", "number", "number", "number",
+                                   "number", "number"],
+                             [req.pcb, on_heap, size, width || 0, height || 0, err, req.meta]);
+                return;
+            }
+            // The sample of the encoded output is recorded by C++ after encoding.
+            if (req.output == RasterOutput.Encode) {
+                const times = takeTimes(req) || [-1, -1, -1, -1, -1, -1, -1];
+                Module.ccall("ExecEncodeCb",
+                             "v", ["number", "number", "number", "number", "number", "number",
+                                   "number", "number", "number", "number", "number", "number",
+                                   "number", "number", "number", "number", "number"],
+                             [req.pcb, req.wrapped, req.level, on_heap, size,
+                              width || 0, height || 0, err, req.meta,
+                              times[0], times[1], times[2], times[3], times[4], times[5],
+                              times[6], req.size]);
+                return;
+            }
+            if (req.output == RasterOutput.Tiles) {
+                execTileCb(req, on_heap, size, err, req.tile || null, true);
+                return;
+            }
+            if (req.output == RasterOutput.Progressive) {
+                execFrameCb(req, on_heap, size, err, width, height, 0, false);
+                return;
+            }
+            if (req.output == RasterOutput.Atlas) { // on_heap is the texture name if !req.raw
+                Module.ccall("ExecAtlasCb",
+                             "v", ["number", "number", "number", "number", "number",
+                                   "number", "number", "number"],
+                             [req.pcb, req.raw ? on_heap : 0, size, req.raw ? 0 : on_heap,
+                              width || 0, height || 0, err, req.meta]);
+                return;
+            }
+            if (req.output == RasterOutput.Texture) {
+                Module.ccall("ExecTextureCb",
+                             "v", ["number", "number", "number", "number", "number", "number"],
+                             [req.pcb, on_heap, width || 0, height || 0, err, req.meta]);
+                return;
+            }
+            if (req.output == RasterOutput.Buffer || req.output == RasterOutput.Async) {
+                const exec = req.output == RasterOutput.Buffer ? "ExecBufferCb" : "ExecAsyncCb";
+                Module.ccall(exec,
+                             "v", ["number", "number", "number", "number", "number"],
+                             [req.pcb, on_heap, size, err, req.meta]);
+                return;
+            }
+            let exec = "ExecCb";
+            if (req.output == RasterOutput.Batch) { exec = "ExecBatchCb"; }
+            else if (req.output == RasterOutput.Slot) { exec = "ExecSlotCb"; }
+            Module.ccall(exec,
                          "v", ["number", "number", "number", "number", "number"],
-                         [pcb, 0, 0, err, meta]);
+                         [req.pcb, on_heap, size, err, req.meta]);
+        }
+
+        // Converts the rejection reason of the pipeline stage to the error code.
+        // Stages reject with the error codes; anything else is an unexpected exception,
+        // which most likely was thrown while drawing.
+        function toError(reason) {
+            return typeof reason === "number" ? reason : RasterError.CanvasDrawingFailed;
+        }
+
+        // Signals the client about an error.
+        function failed(req, err) { guarded(() => { execCb(req, 0, 0, toError(err)); }); }
+
+        // Deferred completions (see raster::SetDeferredCompletions()).
+        // Finished stages queue their delivery (the heap copy, the texture upload,
+        // and the client's callback) instead of running it, so the queue holds JS outputs only.
+        // Cancellation is not deferred: the queued delivery of the done request does nothing.
+        let deferred = false;
+        let completions = [];
+
+        // Runs the delivery now or queues it in the deferred mode.
+        function deliver(fn) {
+            if (deferred) { completions.push(fn); }
+            else { fn(); }
+        }
+
+        // Runs the queued deliveries in order until the budget (ms) is spent.
+        // At least one runs per call, so the queue always drains. Returns the number of runs.
+        // Deliveries call the client's callbacks via guarded(), so they don't throw here.
+        function pumpCompletions(budget) {
+            const end = performance.now() + budget;
+            let count = 0;
+            while (completions.length > 0 && (count == 0 || performance.now() < end)) {
+                const fn = completions.shift();
+                ++count;
+                fn();
+            }
+            return count;
+        }
+
+        // Enables/disables the deferred mode. Disabling runs the queued deliveries at once.
+        function setDeferred(enabled) {
+            deferred = enabled;
+            if (!enabled) { pumpCompletions(Infinity); }
+        }
+
+        // Delivers the rendered output with load (e.g., loadImage()).
+        // In the deferred mode, the output in the worker arena is copied out, so the worker
+        // doesn't wait for the pump to reuse its arena.
+        function deliverOutput(out, load) {
+            if (deferred && out.release) {
+                const copy = { data: out.data.slice(), width: out.width, height: out.height };
+                out.release();
+                out = copy;
+            }
+            deliver(() => {
+                try {
+                    load(out);
+                } finally {
+                    if (out.release) { out.release(); }
+                }
+            });
         }
 
         // Encodes row svg as data uri.
-        // Messages the client about an error and returns null if encoding failed.
-        function svgToDataUri(data, size) {
-            const svg = UTF8ToString(data, size); // emsc
+        // Returns null if encoding failed.
+        function svgToDataUri(req) {
+            const svg = UTF8ToString(req.data, req.size); // emsc
             try {
                 return "data:image/svg+xml;charset=utf8," + encodeURIComponent(svg);
             } catch (e) {
-                failed(RasterError.UriEncodingFailed);
                 return null;
             }
         }
 
-        // Draws svg on <canvas> for further image export.
-        function drawSvg(img, fmt) {
-            let canvas = document.createElement("canvas");
-            // We should explicitly set <canvas> width/height.
-            // Otherwise, default values will be applied (w=300, h=150).
-            // https://developer.mozilla.org/en-US/docs/Web/HTML/Element/canvas
-            if (width == 0) { width = img.width }
-            if (height == 0) { height = img.height }
-            width *= zoom;
-            height *= zoom;
-            canvas.width = width;
-            canvas.height = height;
-            let context = canvas.getContext("2d");
-            try {
-                context.drawImage(img, x, y, width, height);
-                canvas.toBlob(processBlob, fmt, quality);
-            } catch (e) { failed(RasterError.CanvasDrawingFailed); }
+        // Wraps row svg in a blob and returns its object URL.
+        // The heap view is copied by the Blob constructor, so req.data may be freed after the call.
+        // Returns null if blob creation failed.
+        // The chunked svg (see aux::SvgChunksToImage()) is passed as the list of heap views,
+        // which the Blob constructor copies.
+        function svgToBlobUrl(req) {
+            try {
+                const parts = req.chunks
+                    ? req.chunks.map((c) => HEAPU8.subarray(c.data, c.data + c.size)) // emsc
+                    : [HEAPU8.subarray(req.data, req.data + req.size)];
+                const blob = new Blob(parts, { type: "image/svg+xml" });
+                req.url = URL.createObjectURL(blob);
+                return req.url;
+            } catch (e) {
+                return null;
+            }
+        }
+
+        // Returns the source for <img> according to the input mode.
+        function svgToSrc(req) {
+            if (req.input == RasterInput.Blob) { return svgToBlobUrl(req); }
+            // The uri is already percent-encoded in WASM (ASCII only).
+            if (req.input == RasterInput.Uri) { return UTF8ToString(req.data, req.size); } // emsc
+            return svgToDataUri(req);
+        }
+
+        // Returns the output size.
+        // We should explicitly set <canvas> width/height.
+        // Otherwise, default values will be applied (w=300, h=150).
+        // https://developer.mozilla.org/en-US/docs/Web/HTML/Element/canvas
+        function outputSize(target, img) {
+            const width = target.width == 0 ? img.width : target.width;
+            const height = target.height == 0 ? img.height : target.height;
+            return { width: width * target.zoom, height: height * target.zoom };
+        }
+
+        // -------------------------------------------------------------------
+        // Output arena
+        // -------------------------------------------------------------------
+
+        // Ring of the outputs copied to the heap for the callbacks (see raster::SetOutputArena()).
+        // Blocks are allocated at the head and reclaimed from the tail in the allocation order;
+        // a block released out of order is reclaimed when the blocks before it are.
+        // Live blocks (allocated, maybe released) are [start, end) with "wrapped" at 0.
+        // The superseded arena is freed as soon as its last block is released.
+        let out_arena = null;
+        let out_stats = { hits: 0, fallbacks: 0, high_water: 0 };
+
+        function makeArena(capacity) {
+            const base = capacity > 0 ? Module._malloc(capacity) : 0;
+            if (!base) { return null; }
+            return { base: base, capacity: capacity, head: 0, tail: 0, blocks: [], retired: false };
+        }
+
+        // Reserves the arena of the capacity (0 - no arena).
+        function setOutputArena(capacity) {
+            const prev = out_arena;
+            out_arena = makeArena(capacity);
+            if (!prev) { return; }
+            prev.retired = true;
+            if (prev.blocks.length == 0) { Module._free(prev.base); }
+        }
+
+        // Returns the offset of the size in the arena or -1 if it doesn't fit.
+        // The head never reaches the tail from below, so the equal head and tail
+        // mean the empty arena.
+        function arenaOffset(a, size) {
+            if (a.blocks.length == 0) {
+                a.head = 0;
+                a.tail = 0;
+            }
+            if (a.head >= a.tail) { // free space is [head, capacity) and [0, tail)
+                if (a.capacity - a.head >= size) { return a.head; }
+                if (a.tail > size) { return 0; }
+                return -1;
+            }
+            return a.tail - a.head > size ? a.head : -1; // free space is [head, tail)
+        }
+
+        // Allocates the block of the size for the output in the arena or with malloc.
+        function allocOutput(size) {
+            const a = out_arena;
+            const span = Math.max(16, Math.ceil(size / 16) * 16);
+            const offset = a ? arenaOffset(a, span) : -1;
+            if (offset < 0) {
+                ++out_stats.fallbacks;
+                return { ptr: Module._malloc(size), arena: null };
+            }
+            ++out_stats.hits;
+            const block = { ptr: a.base + offset, arena: a, start: offset, released: false };
+            a.blocks.push(block);
+            a.head = offset + span;
+            const used = a.head > a.tail ? a.head - a.tail : a.capacity - a.tail + a.head;
+            out_stats.high_water = Math.max(out_stats.high_water, used);
+            return block;
+        }
+
+        // Releases the output block.
+        function freeOutput(block) {
+            const a = block.arena;
+            if (!a) {
+                Module._free(block.ptr);
+                return;
+            }
+            block.released = true;
+            while (a.blocks.length > 0 && a.blocks[0].released) { a.blocks.shift(); }
+            if (a.blocks.length > 0) { a.tail = a.blocks[0].start; }
+            else if (a.retired) { Module._free(a.base); }
+        }
+
+        // Writes hits, fallbacks, the high-water mark, and the capacity (float64) to the heap.
+        function outputArenaStats(out) {
+            const p = out >> 3;
+            HEAPF64[p] = out_stats.hits; // emsc
+            HEAPF64[p + 1] = out_stats.fallbacks;
+            HEAPF64[p + 2] = out_stats.high_water;
+            HEAPF64[p + 3] = out_arena ? out_arena.capacity : 0;
+        }
+
+        // Loads raster image (or raw pixels) on the heap and calls the callback.
+        function loadImage(req, out) {
+            if (req.done) { return; } // cancelled, skip the copy
+            if (req.output == RasterOutput.Buffer || req.output == RasterOutput.Async) {
+                loadBuffer(req, out);
+                return;
+            }
+            // The output may already be on the heap (in the worker arena, see finished()).
+            const copy_start = performance.now();
+            const in_heap = out.on_heap !== undefined;
+            const block = in_heap ? null : allocOutput(out.data.length);
+            const on_heap = in_heap ? out.on_heap : block.ptr;
+            if (!in_heap) { writeArrayToMemory(out.data, on_heap); } // emsc
+            if (req.t) { req.t.copy = performance.now() - copy_start; }
+            guarded(() => {
+                execCb(req, on_heap, out.data.length, RasterError.None, out.width, out.height);
+            });
+            if (block) { freeOutput(block); }
+        }
+
+        // Loads raster image to the buffer owned by the client and calls the callback.
+        // The buffer is allocated by C++ (see aux::AllocBuffer()) or with malloc
+        // (for the awaitable conversions), and we don't free it.
+        function loadBuffer(req, out) {
+            const copy_start = performance.now();
+            const on_heap = req.output == RasterOutput.Async
+                ? Module._malloc(out.data.length)
+                : Module.ccall("AllocBuffer", "number", ["number", "number"],
+                               [req.pcb, out.data.length]);
+            if (!on_heap) {
+                failed(req, RasterError.BlobExportFailed);
+                return;
+            }
+            writeArrayToMemory(out.data, on_heap); // emsc
+            if (req.t) { req.t.copy = performance.now() - copy_start; }
+            guarded(() => { execCb(req, on_heap, out.data.length, RasterError.None); });
+        }
+
+        // -------------------------------------------------------------------
+        // Pipeline stages
+        // Each stage returns a promise rejected with the error code.
+        // The output of the render stage is { data: <typed array>, width, height }.
+        // The target of the render stage is { format, quality, x, y, width, height, zoom, raw }.
+        // -------------------------------------------------------------------
+
+        // Loads svg to <img>.
+        // Attention: req.data is read synchronously, so it may be freed after the call.
+        function loadSvg(req) {
+            return new Promise((resolve, reject) => {
+                const t = req.t;
+                const encode_start = performance.now();
+                const src = svgToSrc(req);
+                if (t) { t.encode = performance.now() - encode_start; }
+                if (src === null) {
+                    reject(RasterError.UriEncodingFailed);
+                    return;
+                }
+                let img = document.createElement("img");
+                req.img = img;
+                const load_start = performance.now();
+                // For browser compatibility, we use two possible names of the same event.
+                img.error = (event) => { reject(RasterError.ImgLoadingFailed); };
+                img.onerror = (event) => { reject(RasterError.ImgLoadingFailed); };
+                img.onload = (event) => {
+                    if (t) { t.load = performance.now() - load_start; }
+                    resolve(img);
+                };
+                img.src = src;
+            });
+        }
+
+        // Reads the blob exported from <canvas>.
+        // T is the timings of the request (if stats are enabled).
+        function readBlob(blob, width, height, t) {
+            if (!blob) { return Promise.reject(RasterError.BlobExportFailed); }
+            const read_start = performance.now();
+            return blob.arrayBuffer().then(
+                (buf) => {
+                    if (t) { t.read = performance.now() - read_start; }
+                    return { data: new Uint8Array(buf), width: width, height: height };
+                },
+                (e) => Promise.reject(RasterError.BlobExportFailed));
+        }
+
+        // -------------------------------------------------------------------
+        // Canvas pool
+        // -------------------------------------------------------------------
+
+        // Free main-thread canvases by key (see canvasKey()),
+        // each is { canvas, context, key, width, height } (width x height is the drawn rect).
+        // The context attributes can't be changed after creation, so raw outputs
+        // (willReadFrequently) and encoded ones use separate canvases.
+        let canvas_pool = new Map();
+        let canvas_pool_size = 0; // free canvases in the pool
+        let canvas_pool_cap = 16;
+        let canvas_stats = { hits: 0, misses: 0, drops: 0 };
+
+        // Returns the canvas size for the output: raw canvases are read back by the output
+        // rect (see getImageData()), so their size is rounded up to powers of two, and
+        // a canvas fits any output of the bucket. toBlob() and texImage2D() take the whole
+        // canvas, so the encoded ones have the exact size.
+        function canvasSize(width, height, raw) {
+            if (!raw) { return { width: width, height: height }; }
+            let w = 1;
+            let h = 1;
+            while (w < width) { w *= 2; }
+            while (h < height) { h *= 2; }
+            return { width: w, height: h };
+        }
+
+        // Returns the pool key: the raw flag and the canvas size (see canvasSize()).
+        function canvasKey(size, raw) {
+            return (raw ? "raw:" : "enc:") + size.width + "x" + size.height;
+        }
+
+        // Returns the canvas for the output of the size with its 2D context
+        // (from the pool, if any). The output rect (0, 0, width, height) is cleared.
+        // The canvas may be released as soon as the snapshot is taken: toBlob(), getImageData(),
+        // and texImage2D() take it synchronously.
+        function acquireCanvas(width, height, raw) {
+            width = Math.trunc(width);
+            height = Math.trunc(height);
+            const size = canvasSize(width, height, raw);
+            const key = canvasKey(size, raw);
+            const free = canvas_pool.get(key);
+            if (free && free.length > 0) {
+                const entry = free.pop();
+                --canvas_pool_size;
+                ++canvas_stats.hits;
+                // The canvas keeps its size, so the backing store isn't reallocated.
+                // Only the output rect is read back, so only it is cleared.
+                entry.context.setTransform(1, 0, 0, 1, 0, 0);
+                entry.context.clearRect(0, 0, width, height);
+                entry.width = width;
+                entry.height = height;
+                return entry;
+            }
+            ++canvas_stats.misses;
+            let canvas = document.createElement("canvas");
+            canvas.width = size.width;
+            canvas.height = size.height;
+            const context = canvas.getContext("2d", { willReadFrequently: raw });
+            return { canvas: canvas, context: context, key: key, width: width, height: height };
+        }
+
+        // Returns the canvas to the pool. If the pool is full, the canvas is dropped,
+        // and its backing store is released without waiting for GC.
+        function releaseCanvas(entry) {
+            if (canvas_pool_size >= canvas_pool_cap) {
+                ++canvas_stats.drops;
+                entry.canvas.width = 0;
+                entry.canvas.height = 0;
+                return;
+            }
+            let free = canvas_pool.get(entry.key);
+            if (!free) {
+                free = [];
+                canvas_pool.set(entry.key, free);
+            }
+            free.push(entry);
+            ++canvas_pool_size;
+        }
+
+        // Sets the pool capacity (free canvases), dropping the extra ones.
+        function setCanvasPool(cap) {
+            canvas_pool_cap = cap;
+            for (const free of canvas_pool.values()) {
+                while (canvas_pool_size > canvas_pool_cap && free.length > 0) {
+                    const entry = free.pop();
+                    entry.canvas.width = 0;
+                    entry.canvas.height = 0;
+                    --canvas_pool_size;
+                }
+            }
+        }
+
+        // Writes hits, misses, drops, and pooled canvases (float64) to the heap.
+        function canvasStats(out) {
+            const p = out >> 3;
+            HEAPF64[p] = canvas_stats.hits; // emsc
+            HEAPF64[p + 1] = canvas_stats.misses;
+            HEAPF64[p + 2] = canvas_stats.drops;
+            HEAPF64[p + 3] = canvas_pool_size;
+        }
+
+        // Draws svg on <canvas> and exports the image on the main thread.
+        // The pooled canvas is released as soon as the function returns
+        // because toBlob() and getImageData() take the canvas snapshot synchronously.
+        function renderOnMain(img, target) {
+            return new Promise((resolve, reject) => {
+                const size = outputSize(target, img);
+                const entry = acquireCanvas(size.width, size.height, target.raw);
+                const canvas = entry.canvas;
+                const context = entry.context;
+                const width = entry.width;
+                const height = entry.height;
+                const t = target.t;
+                let pixels = null;
+                try {
+                    const draw_start = performance.now();
+                    context.drawImage(img, target.x, target.y, size.width, size.height);
+                    if (target.raw) { pixels = context.getImageData(0, 0, width, height); }
+                    if (t) { t.draw = performance.now() - draw_start; }
+                    if (!target.raw) {
+                        const export_start = performance.now();
+                        canvas.toBlob((blob) => {
+                            if (target.done) { // cancelled, skip the read
+                                reject(RasterError.Cancelled);
+                                return;
+                            }
+                            if (t) { t.export = performance.now() - export_start; }
+                            readBlob(blob, width, height, t).then(resolve, reject);
+                        }, target.format, target.quality);
+                    }
+                } catch (e) {
+                    reject(RasterError.CanvasDrawingFailed);
+                    return;
+                } finally {
+                    releaseCanvas(entry);
+                }
+                if (pixels) { resolve({ data: pixels.data, width: width, height: height }); }
+            });
+        }
+
+        // Draws svg and exports the image with the requested backend.
+        // Cancelled requests are rejected without drawing.
+        function render(req, img, target) {
+            if (req.done) { return Promise.reject(RasterError.Cancelled); }
+            if (req.backend == RasterBackend.Worker && getPool() !== null) {
+                return renderInWorker(img, target, target === req);
+            }
+            return renderOnMain(img, target);
+        }
+
+        // -------------------------------------------------------------------
+        // Worker backend
+        // -------------------------------------------------------------------
+
+        // Entry point of the rasterization worker.
+        // The function is serialized with toString() and executed in the worker scope.
+        // Thus, it should not refer to anything except its arguments and the worker globals.
+        // With shared memory, the worker gets its arena in the WASM heap (the init message)
+        // and writes the outputs that fit the arena directly into it.
+        function workerMain(errors) {
+            let heap = null;
+            let arena = 0;
+            let capacity = 0;
+            onmessage = (event) => {
+                const job = event.data;
+                if (job.init) {
+                    heap = job.heap;
+                    arena = job.arena;
+                    capacity = job.capacity;
+                    return;
+                }
+                function reply(err, buf, width, height) {
+                    if (buf && heap && buf.byteLength <= capacity) {
+                        new Uint8Array(heap, arena, buf.byteLength).set(new Uint8Array(buf));
+                        postMessage({ id: job.id, err: err, shared: true, size: buf.byteLength,
+                                      width: width, height: height });
+                        return;
+                    }
+                    const msg = { id: job.id, err: err, buf: buf, width: width, height: height };
+                    if (buf) { postMessage(msg, [buf]); }
+                    else { postMessage(msg); }
+                }
+                let canvas = null;
+                let pixels = null;
+                try {
+                    canvas = new OffscreenCanvas(job.width, job.height);
+                    let context = canvas.getContext("2d", { willReadFrequently: job.raw });
+                    context.drawImage(job.bitmap, job.x, job.y, job.width, job.height);
+                    if (job.raw) { pixels = context.getImageData(0, 0, canvas.width, canvas.height); }
+                } catch (e) {
+                    reply(errors.CanvasDrawingFailed, null, 0, 0);
+                    return;
+                } finally {
+                    job.bitmap.close();
+                }
+                if (pixels) {
+                    reply(errors.None, pixels.data.buffer, pixels.width, pixels.height);
+                    return;
+                }
+                canvas.convertToBlob({ type: job.format, quality: job.quality })
+                    .then((blob) => blob.arrayBuffer())
+                    .then((buf) => { reply(errors.None, buf, canvas.width, canvas.height); },
+                          (e) => { reply(errors.BlobExportFailed, null, 0, 0); });
+            };
+        }
+
+        // The worker pool is created on the first use.
+        // Undefined - not created yet, null - unavailable (so we fall back to the main thread).
+        // Each worker is { worker, deque, current, dead, arena, arena_busy, jobs, steals, busy,
+        // started }.
+        // Jobs wait in the per-worker deques on the main thread; a worker runs one job
+        // at a time, and an idle worker with the empty deque steals from the back
+        // of the longest deque (see pump()).
+        let pool = undefined;
+        let pool_size = 0; // 0 - navigator.hardwareConcurrency
+        let pool_depth = 64; // max jobs per deque
+        let pool_next = 0; // round-robin position for the new jobs
+        let arena_size = 8 * 1024 * 1024; // per-worker output arena (shared memory only)
+        let worker_url = null;
+        let worker_next_id = 1;
+
+        // Creates the pool worker. Returns null on failure.
+        function createWorker() {
+            let w = null;
+            try {
+                w = { worker: new Worker(worker_url), deque: [], current: null, dead: false,
+                      jobs: 0, steals: 0, busy: 0, started: performance.now() };
+            } catch (e) {
+                return null;
+            }
+            w.worker.onmessage = (event) => { finished(w, event.data); };
+            w.worker.onerror = (event) => { crashed(w); };
+            // With shared memory (-pthread or -sSHARED_MEMORY), the worker writes outputs
+            // to its arena in the WASM heap, so we skip the transfer and the heap copy.
+            w.arena = 0;
+            w.arena_busy = false;
+            if (typeof SharedArrayBuffer !== "undefined"
+                && HEAPU8.buffer instanceof SharedArrayBuffer) { // emsc
+                w.arena = Module._malloc(arena_size);
+                if (w.arena) {
+                    w.worker.postMessage({ init: true, heap: HEAPU8.buffer, arena: w.arena,
+                                           capacity: arena_size });
+                }
+            }
+            return w;
+        }
+
+        // Terminates the dead worker. Its arena is freed as soon as the client releases it.
+        function retire(w) {
+            w.worker.terminate();
+            if (!w.arena_busy) { freeArena(w); }
+        }
+
+        function freeArena(w) {
+            if (w.arena) {
+                Module._free(w.arena);
+                w.arena = 0;
+            }
+        }
+
+        // Called when the client has consumed the output in the worker arena.
+        function releaseArena(w) {
+            w.arena_busy = false;
+            if (w.dead) { freeArena(w); }
+            else { pump(w); }
+        }
+
+        // Returns the target pool size.
+        function poolSize() {
+            if (pool_size > 0) { return pool_size; }
+            const cores = typeof navigator === "undefined" ? 0 : navigator.hardwareConcurrency;
+            return Math.max(1, cores || 1);
+        }
+
+        // Returns the alive workers.
+        function aliveWorkers() {
+            return pool ? pool.filter((w) => !w.dead) : [];
+        }
+
+        // Returns the worker pool or null if the browser doesn't support it.
+        function getPool() {
+            if (pool !== undefined) { return pool; }
+            pool = null;
+            if (typeof Worker === "undefined" || typeof OffscreenCanvas === "undefined"
+                || typeof createImageBitmap === "undefined") { return null; }
+            try {
+                const src = "(" + workerMain.toString() + ")("
+                            + JSON.stringify(RasterError) + ");";
+                worker_url = URL.createObjectURL(new Blob([src], { type: "text/javascript" }));
+            } catch (e) {
+                return null;
+            }
+            pool = [];
+            resizePool();
+            if (pool.length == 0) { pool = null; }
+            return pool;
+        }
+
+        // Grows or shrinks the pool to poolSize().
+        // Retired workers finish the current job; their deques are stolen by the others.
+        function resizePool() {
+            let alive = aliveWorkers();
+            const size = poolSize();
+            for (let i = alive.length; i < size; ++i) {
+                const w = createWorker();
+                if (w === null) { break; }
+                pool.push(w);
+            }
+            alive.slice(size).forEach((w) => {
+                w.dead = true;
+                if (!w.current) { retire(w); }
+            });
+            pool.forEach(pump);
+        }
+
+        // Sets the pool size, the deque depth, and the arena size (see raster::SetWorkerPool()).
+        // The arena size applies to the new workers.
+        function setPool(size, depth, arena) {
+            pool_size = size;
+            pool_depth = Math.max(1, depth);
+            arena_size = arena;
+            if (pool) { resizePool(); }
+        }
+
+        // Returns the worker for the new job (round-robin over the workers with free deque slots)
+        // or null if the pool is unavailable or saturated.
+        function pickWorker() {
+            if (!pool) { return null; }
+            for (let i = 0; i < pool.length; ++i) {
+                const w = pool[(pool_next + i) % pool.length];
+                if (!w.dead && w.deque.length < pool_depth) {
+                    pool_next = (pool_next + i + 1) % pool.length;
+                    return w;
+                }
+            }
+            return null;
+        }
+
+        // Returns the next job for the idle worker: its own deque front or the stolen one.
+        function nextJob(w) {
+            if (w.deque.length > 0) { return w.deque.shift(); }
+            let victim = null;
+            pool.forEach((other) => {
+                if (other !== w && other.deque.length > 0
+                    && (victim === null || other.deque.length > victim.deque.length)) {
+                    victim = other;
+                }
+            });
+            if (victim === null) { return null; }
+            ++w.steals;
+            return victim.deque.pop();
+        }
+
+        // Sends the next job to the idle worker.
+        // The worker waits while its arena holds the previous output (see finished()).
+        // Jobs of the cancelled requests are dropped without drawing.
+        function pump(w) {
+            while (!w.dead && !w.current && !w.arena_busy) {
+                const job = nextJob(w);
+                if (job === null) { return; }
+                if (job.target.done) {
+                    job.msg.bitmap.close();
+                    job.reject(RasterError.Cancelled);
+                    continue;
+                }
+                job.sent = performance.now();
+                w.current = job;
+                w.worker.postMessage(job.msg, [job.msg.bitmap]);
+            }
+        }
+
+        // Completes the current job of the worker and sends the next one.
+        // The output in the arena is passed in place (as a heap view with the release function)
+        // to the single-output requests, which consume it at once (see svgToImage()).
+        // For the others, it is copied out, so the arena is free for the next job.
+        function finished(w, msg) {
+            const job = w.current;
+            w.current = null;
+            if (!job || job.msg.id != msg.id) { return; }
+            w.busy += performance.now() - job.sent;
+            ++w.jobs;
+            let out = null;
+            if (msg.err == RasterError.None && msg.shared) {
+                const view = HEAPU8.subarray(w.arena, w.arena + msg.size); // emsc
+                if (job.inplace) {
+                    w.arena_busy = true;
+                    out = { data: view, width: msg.width, height: msg.height, on_heap: w.arena,
+                            release: () => { releaseArena(w); } };
+                } else {
+                    out = { data: view.slice(), width: msg.width, height: msg.height };
+                }
+            } else if (msg.err == RasterError.None) {
+                out = { data: new Uint8Array(msg.buf), width: msg.width, height: msg.height };
+            }
+            if (w.dead) { retire(w); }
+            else { pump(w); }
+            if (out === null) { job.reject(msg.err); }
+            else { job.resolve(out); }
+        }
+
+        // The worker seems broken, so we fail its current job and retire it.
+        // The queued jobs are stolen by the other workers; if none is alive,
+        // they fail, and the next jobs are processed on the main thread.
+        function crashed(w) {
+            const job = w.current;
+            w.current = null;
+            w.dead = true;
+            retire(w);
+            if (job) { job.reject(RasterError.CanvasDrawingFailed); }
+            if (!pool) { return; }
+            if (aliveWorkers().length > 0) {
+                pool.forEach(pump);
+                return;
+            }
+            const jobs = [];
+            pool.forEach((other) => { jobs.push(...other.deque); other.deque = []; });
+            pool = null;
+            jobs.forEach((job) => {
+                job.msg.bitmap.close();
+                job.reject(RasterError.CanvasDrawingFailed);
+            });
+        }
+
+        // Writes the stats of the alive workers to the heap (see raster::GetWorkerStats()).
+        // Layout: [jobs, steals, queued, busy ms, utilization] (float64) per worker.
+        // Returns the number of workers written.
+        function workerStats(out, max) {
+            const alive = aliveWorkers().slice(0, max);
+            const now = performance.now();
+            alive.forEach((w, i) => {
+                const p = (out >> 3) + i * 5;
+                HEAPF64[p] = w.jobs; // emsc
+                HEAPF64[p + 1] = w.steals;
+                HEAPF64[p + 2] = w.deque.length + (w.current ? 1 : 0);
+                HEAPF64[p + 3] = w.busy;
+                HEAPF64[p + 4] = now > w.started ? w.busy / (now - w.started) : 0;
+            });
+            return alive.length;
+        }
+
+        // Decodes <img> to ImageBitmap and queues it to the worker pool for drawing and export.
+        // The bitmap is rasterized at the output size, so zoom doesn't lose quality.
+        // If the pool is saturated (all deques are full), the target is rendered on the main thread.
+        // Inplace means the output may be passed in the worker arena (see finished()).
+        function renderInWorker(img, target, inplace) {
+            if (pickWorker() === null) { return renderOnMain(img, target); }
+            const size = outputSize(target, img);
+            const opts = {
+                resizeWidth: Math.max(1, Math.round(size.width)),
+                resizeHeight: Math.max(1, Math.round(size.height)),
+                resizeQuality: "high",
+            };
+            const t = target.t;
+            const decode_start = performance.now();
+            function onDecoded(bitmap) {
+                if (t) { t.draw = performance.now() - decode_start; }
+                const w = pickWorker();
+                if (w === null) { // the pool failed or saturated while we were decoding
+                    bitmap.close();
+                    return renderOnMain(img, target);
+                }
+                const export_start = performance.now();
+                return new Promise((resolve, reject) => {
+                    const msg = { id: worker_next_id++, bitmap: bitmap, raw: target.raw,
+                                  format: target.format, quality: target.quality,
+                                  x: target.x, y: target.y,
+                                  width: size.width, height: size.height };
+                    w.deque.push({ msg: msg, target: target, inplace: inplace,
+                                   resolve: resolve, reject: reject });
+                    pool.forEach(pump); // the idle workers may steal the job at once
+                }).then((out) => {
+                    if (t) { t.export = performance.now() - export_start; }
+                    return out;
+                });
+            }
+            return createImageBitmap(img, opts).then(
+                onDecoded, (e) => Promise.reject(RasterError.CanvasDrawingFailed));
+        }
+
+        // -------------------------------------------------------------------
+        // Textures
+        // -------------------------------------------------------------------
+
+        // Creates a new texture of the WebGL context, and upload(gl) fills it.
+        // The texture is registered in GL.textures, so C++ may use it as an ordinary GLuint.
+        // Returns the texture name (0 on failure). The texture binding is restored.
+        function createTexture(ctx, upload) {
+            const gl_ctx = typeof GL === "undefined" ? null : GL.contexts[ctx]; // emsc
+            if (!gl_ctx) { return 0; }
+            const gl = gl_ctx.GLctx;
+            try {
+                const prev = gl.getParameter(gl.TEXTURE_BINDING_2D);
+                const tex = gl.createTexture();
+                gl.bindTexture(gl.TEXTURE_2D, tex);
+                gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MIN_FILTER, gl.LINEAR);
+                gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_MAG_FILTER, gl.LINEAR);
+                gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_S, gl.CLAMP_TO_EDGE);
+                gl.texParameteri(gl.TEXTURE_2D, gl.TEXTURE_WRAP_T, gl.CLAMP_TO_EDGE);
+                upload(gl);
+                gl.bindTexture(gl.TEXTURE_2D, prev);
+                const id = GL.getNewId(GL.textures); // emsc
+                tex.name = id;
+                GL.textures[id] = tex;
+                return id;
+            } catch (e) {
+                return 0;
+            }
+        }
+
+        // Uploads the image source (<img>/<canvas>) to a new texture of the WebGL context.
+        function uploadTexture(req, source, width, height) {
+            const id = createTexture(req.ctx, (gl) => {
+                gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, gl.RGBA, gl.UNSIGNED_BYTE, source);
+            });
+            if (id == 0) {
+                failed(req, RasterError.TextureUploadFailed);
+                return;
+            }
+            guarded(() => { execCb(req, id, 0, RasterError.None, width, height); });
+        }
+
+        // Draws svg and uploads it to the texture.
+        // If the output matches the <img> as is, we upload <img> directly.
+        function drawTexture(req, img) {
+            if (req.done) { return; } // cancelled
+            const size = outputSize(req, img);
+            if (req.x == 0 && req.y == 0 && size.width == img.width && size.height == img.height) {
+                uploadTexture(req, img, img.width, img.height);
+                return;
+            }
+            const entry = acquireCanvas(size.width, size.height, false);
+            const canvas = entry.canvas;
+            try {
+                entry.context.drawImage(img, req.x, req.y, size.width, size.height);
+            } catch (e) {
+                releaseCanvas(entry);
+                failed(req, RasterError.CanvasDrawingFailed);
+                return;
+            }
+            uploadTexture(req, canvas, entry.width, entry.height); // doesn't throw
+            releaseCanvas(entry);
+        }
+
+        // -------------------------------------------------------------------
+        // Tiles
+        // -------------------------------------------------------------------
+
+        // Executes the client's tile callback. Tile is null for errors.
+        function execTileCb(req, on_heap, size, err, tile, last) {
+            const t = tile || { col: 0, row: 0, cols: 0, rows: 0, x: 0, y: 0, width: 0, height: 0 };
+            const stride = tile && req.raw ? tile.width * 4 : 0;
+            Module.ccall("ExecTileCb",
+                         "v", ["number", "number", "number", "number", "number", "number",
+                               "number", "number", "number", "number", "number", "number",
+                               "number", "number", "number"],
+                         [req.pcb, on_heap, size, t.col, t.row, t.cols, t.rows, t.x, t.y,
+                          t.width, t.height, stride, err, last ? 1 : 0, req.meta]);
+        }
+
+        // Loads the tile on the heap and calls the callback.
+        // The last tile completes the request (see execCb()).
+        function loadTile(req, out, tile, last) {
+            const block = allocOutput(out.data.length);
+            const on_heap = block.ptr;
+            writeArrayToMemory(out.data, on_heap); // emsc
+            guarded(() => {
+                if (last) {
+                    req.tile = tile;
+                    execCb(req, on_heap, out.data.length, RasterError.None);
+                } else {
+                    execTileCb(req, on_heap, out.data.length, RasterError.None, tile, false);
+                }
+            });
+            freeOutput(block);
+        }
+
+        // Draws the tile of the output on the pooled <canvas> and exports it.
+        // The image is drawn at the full output size, offset by the tile position,
+        // so the canvas holds only the tile.
+        function renderTile(req, img, size, tile) {
+            return new Promise((resolve, reject) => {
+                const entry = acquireCanvas(tile.width, tile.height, req.raw);
+                const canvas = entry.canvas;
+                const context = entry.context;
+                try {
+                    context.drawImage(img, -tile.x, -tile.y, size.width, size.height);
+                    if (req.raw) {
+                        const pixels = context.getImageData(0, 0, tile.width, tile.height);
+                        resolve({ data: pixels.data, width: tile.width, height: tile.height });
+                        return;
+                    }
+                    canvas.toBlob((blob) => {
+                        if (req.done) { // cancelled, skip the read
+                            reject(RasterError.Cancelled);
+                            return;
+                        }
+                        readBlob(blob, tile.width, tile.height, null).then(resolve, reject);
+                    }, req.format, req.quality);
+                } catch (e) {
+                    reject(RasterError.CanvasDrawingFailed);
+                } finally {
+                    releaseCanvas(entry);
+                }
+            });
+        }
+
+        // Converts svg to raster image split into tiles.
+        // Tiles are rendered sequentially, so only one tile is alive at a time.
+        // Returns the request id (see cancel()).
+        function svgToTiles(req) {
+            const id = track(req);
+            req.raw = req.format.length == 0;
+            req.t = stats ? { start: performance.now() } : null;
+            loadSvg(req).then((img) => {
+                const size = outputSize(req, img);
+                const width = Math.ceil(size.width);
+                const height = Math.ceil(size.height);
+                const cols = Math.max(1, Math.ceil(width / req.tile_size));
+                const rows = Math.max(1, Math.ceil(height / req.tile_size));
+                function next(idx) {
+                    if (req.done) { return; } // cancelled
+                    const col = idx % cols;
+                    const row = Math.floor(idx / cols);
+                    const x = col * req.tile_size;
+                    const y = row * req.tile_size;
+                    const tile = { col: col, row: row, cols: cols, rows: rows, x: x, y: y,
+                                   width: Math.min(req.tile_size, width - x),
+                                   height: Math.min(req.tile_size, height - y) };
+                    renderTile(req, img, size, tile).then((out) => {
+                        deliver(() => {
+                            if (req.done) { return; }
+                            const last = idx + 1 == cols * rows;
+                            loadTile(req, out, tile, last);
+                            if (!last) { next(idx + 1); }
+                        });
+                    }, (err) => { deliver(() => { failed(req, err); }); });
+                }
+                next(0);
+            }, (err) => { deliver(() => { failed(req, err); }); });
+            return id;
+        }
+
+        // -------------------------------------------------------------------
+        // Progressive output
+        // -------------------------------------------------------------------
+
+        // Executes the client's progressive callback.
+        function execFrameCb(req, on_heap, size, err, width, height, stride, preliminary) {
+            Module.ccall("ExecProgressiveCb",
+                         "v", ["number", "number", "number", "number", "number", "number",
+                               "number", "number", "number"],
+                         [req.pcb, on_heap, size, width || 0, height || 0, stride, err,
+                          preliminary ? 1 : 0, req.meta]);
+        }
+
+        // Loads the preview on the heap and calls the callback.
+        // The output may already be on the heap (in the worker arena, see finished()).
+        function loadPreview(req, out, raw) {
+            const in_heap = out.on_heap !== undefined;
+            const block = in_heap ? null : allocOutput(out.data.length);
+            const on_heap = in_heap ? out.on_heap : block.ptr;
+            if (!in_heap) { writeArrayToMemory(out.data, on_heap); } // emsc
+            guarded(() => {
+                execFrameCb(req, on_heap, out.data.length, RasterError.None,
+                            out.width, out.height, raw ? out.width * 4 : 0, true);
+            });
+            if (block) { freeOutput(block); }
+        }
+
+        // Renders the preview of the loaded <img> unless the output is small.
+        // The preview shares the request, so it is dropped as soon as the request is done
+        // (the full output landed or the request was cancelled).
+        function renderPreview(req, img) {
+            const size = outputSize(req, img);
+            if (size.width * size.height < req.min_pixels) { return; }
+            const scale = req.preview_scale;
+            const target = {
+                format: req.preview_format, quality: req.preview_quality,
+                x: req.x * scale, y: req.y * scale, width: req.width, height: req.height,
+                zoom: req.zoom * scale, raw: req.preview_format.length == 0, t: null,
+                get done() { return req.done; },
+            };
+            render(req, img, target).then((out) => {
+                deliverOutput(out, (o) => { if (!req.done) { loadPreview(req, o, target.raw); } });
+            }, (err) => {}); // the full output reports errors
+        }
+
+        // Converts svg to raster image with the preview.
+        // The preview is started first, so it is drawn before the full output.
+        // Returns the request id (see cancel()).
+        function svgToProgressive(req) {
+            const id = track(req);
+            req.raw = false;
+            req.t = stats ? { start: performance.now() } : null;
+            const loaded = loadSvg(req);
+            loaded.then((img) => { renderPreview(req, img); }, (err) => {});
+            renderLoaded(req, loaded);
+            return id;
+        }
+
+        // -------------------------------------------------------------------
+        // Multiple targets
+        // -------------------------------------------------------------------
+
+        // Executes the client's callback for a single target.
+        function execTargetCb(req, idx, on_heap, size, err, last) {
+            if (last) { release(req); }
+            Module.ccall("ExecTargetCb",
+                         "v", ["number", "number", "number", "number", "number", "number",
+                               "number"],
+                         [req.pcb, idx, on_heap, size, err, last ? 1 : 0, req.meta]);
+        }
+
+        // Loads a single target output on the heap and calls the callback.
+        function loadTarget(req, idx, out, last) {
+            const block = allocOutput(out.data.length);
+            const on_heap = block.ptr;
+            writeArrayToMemory(out.data, on_heap); // emsc
+            guarded(() => {
+                execTargetCb(req, idx, on_heap, out.data.length, RasterError.None, last);
+            });
+            freeOutput(block);
+        }
+
+        // Loads all target outputs on the heap and calls the callback.
+        // Heap layout: [offset, size, error] (uint32) per target followed by the output data.
+        function loadTargets(req, results) {
+            const count = results.length;
+            let total = count * 12;
+            results.forEach((res) => { if (res.out) { total += res.out.data.length; } });
+            const block = allocOutput(total);
+            const on_heap = block.ptr;
+            let offset = count * 12;
+            results.forEach((res, i) => {
+                const entry = (on_heap >> 2) + i * 3;
+                const size = res.out ? res.out.data.length : 0;
+                HEAPU32[entry] = offset; // emsc
+                HEAPU32[entry + 1] = size;
+                HEAPU32[entry + 2] = res.err;
+                if (res.out) { HEAPU8.set(res.out.data, on_heap + offset); }
+                offset += size;
+            });
+            release(req);
+            guarded(() => {
+                Module.ccall("ExecTargetsCb",
+                             "v", ["number", "number", "number", "number"],
+                             [req.pcb, on_heap, count, req.meta]);
+            });
+            freeOutput(block);
+        }
+
+        // Converts svg to many raster images.
+        // The svg is loaded to <img> once; all targets are drawn on the same <canvas>.
+        // If req.each is set, the callback is called per target as soon as the target is ready.
+        // Otherwise, the callback is called once with all outputs.
+        function svgToTargets(req) {
+            const count = req.targets.length;
+            let left = count;
+            function settled(idx, out, err) {
+                --left;
+                const last = left == 0;
+                if (req.each) {
+                    deliver(() => {
+                        if (out) { loadTarget(req, idx, out, last); }
+                        else {
+                            guarded(() => { execTargetCb(req, idx, 0, 0, toError(err), last); });
+                        }
+                    });
+                    return;
+                }
+                req.results[idx] = { out: out, err: out ? RasterError.None : toError(err) };
+                if (last) { deliver(() => { loadTargets(req, req.results); }); }
+            }
+            req.results = new Array(count);
+            loadSvg(req).then((img) => {
+                req.targets.forEach((target, idx) => {
+                    render(req, img, target).then(
+                        (out) => { settled(idx, out, null); },
+                        (err) => { settled(idx, null, err); });
+                });
+            }, (err) => {
+                for (let idx = 0; idx < count; ++idx) { settled(idx, null, err); }
+            });
+        }
+
+        // -------------------------------------------------------------------
+        // Atlas
+        // -------------------------------------------------------------------
+
+        // Packs and draws the loaded icons of the atlas, then reads back or uploads the atlas.
+        // Missing icons (failed to load) are null.
+        function finishAtlas(req, imgs) {
+            req.icons.forEach((icon) => { release(icon); });
+            if (req.done) { return; } // cancelled
+            // Rects are x, y, width, height per icon, followed by the atlas size (int32).
+            const count = imgs.length;
+            const rects = Module._malloc((count * 4 + 2) * 4);
+            imgs.forEach((img, i) => {
+                const size = img ? outputSize(req, img) : { width: 0, height: 0 };
+                HEAP32[(rects >> 2) + i * 4 + 2] = Math.ceil(size.width); // emsc
+                HEAP32[(rects >> 2) + i * 4 + 3] = Math.ceil(size.height); // emsc
+            });
+            const packed = Module.ccall("PackAtlas", "number",
+                                        ["number", "number", "number"],
+                                        [req.pcb, rects, count]);
+            const p = rects >> 2; // the heap may grow in PackAtlas()
+            const width = HEAP32[p + count * 4]; // emsc
+            const height = HEAP32[p + count * 4 + 1]; // emsc
+            let entry = null;
+            let pixels = null;
+            let err = packed ? RasterError.None : RasterError.CanvasDrawingFailed;
+            if (packed) {
+                entry = acquireCanvas(width, height, req.raw);
+                const context = entry.context;
+                try {
+                    imgs.forEach((img, i) => {
+                        const r = p + i * 4;
+                        if (!img || HEAP32[r + 2] == 0) { return; } // not packed
+                        context.drawImage(img, HEAP32[r], HEAP32[r + 1],
+                                          HEAP32[r + 2], HEAP32[r + 3]);
+                    });
+                    if (req.raw) { pixels = context.getImageData(0, 0, width, height); }
+                } catch (e) {
+                    err = RasterError.CanvasDrawingFailed;
+                }
+            }
+            Module._free(rects);
+            if (err != RasterError.None) {
+                if (entry) { releaseCanvas(entry); }
+                failed(req, err);
+                return;
+            }
+            if (!req.raw) {
+                uploadTexture(req, entry.canvas, width, height); // doesn't throw
+                releaseCanvas(entry);
+                return;
+            }
+            releaseCanvas(entry); // getImageData() has copied the pixels
+            loadImage(req, { data: pixels.data, width: width, height: height });
+        }
+
+        // Builds the sprite atlas (see raster::BuildAtlas()).
+        // The icons are loaded in parallel, their sizes are packed in C++ (see aux::PackAtlas()),
+        // then all icons are drawn on a single canvas, which is read back or uploaded once.
+        // Returns the request id (see cancel()).
+        function buildAtlas(req) {
+            const id = track(req);
+            req.raw = !req.ctx;
+            req.t = null;
+            const loads = req.icons.map((icon) => icon.size == 0
+                ? Promise.resolve(null)
+                : loadSvg(icon).then((img) => img, (err) => null));
+            Promise.all(loads).then((imgs) => { deliver(() => { finishAtlas(req, imgs); }); });
+            return id;
+        }
+
+        // -------------------------------------------------------------------
+        // Main
+        // -------------------------------------------------------------------
+
+        // Converts svg to raster image.
+        // The request holds all the arguments of aux::SvgToImage().
+        // Returns the request id (see cancel()).
+        function svgToImage(req) {
+            const id = track(req);
+            req.raw = req.output == RasterOutput.Pixels || req.output == RasterOutput.Encode;
+            req.t = stats ? { start: performance.now() } : null;
+            renderLoaded(req, loadSvg(req));
+            return id;
+        }
+
+        // Renders <img> to the request output as soon as it is loaded.
+        function renderLoaded(req, loaded) {
+            if (req.output == RasterOutput.Texture) {
+                loaded.then((img) => { deliver(() => { drawTexture(req, img); }); },
+                            (err) => { deliver(() => { failed(req, err); }); });
+                return;
+            }
+            // The output in the worker arena is released after the callback returns.
+            loaded.then((img) => render(req, img, req))
+                  .then((out) => { deliverOutput(out, (o) => { loadImage(req, o); }); },
+                        (err) => { deliver(() => { failed(req, err); }); });
+        }
+
+        // -------------------------------------------------------------------
+        // Handles
+        // -------------------------------------------------------------------
+
+        // Loaded svgs (id -> promise of <img>) kept alive for repeated renders
+        // (see raster::SvgHandle).
+        let handles = new Map();
+        let next_handle_id = 1;
+
+        // Loads svg to <img> and returns the handle id.
+        // The request holds the svg arguments of aux::SvgToImage() (data, size, input).
+        function loadHandle(req) {
+            const id = next_handle_id++;
+            req.t = null;
+            const loaded = loadSvg(req);
+            // The blob url is not needed after loading; <img> stays with the promise.
+            loaded.then(() => { release(req); }, () => { release(req); });
+            handles.set(id, loaded);
+            return id;
+        }
+
+        // Renders the loaded svg of the handle (the same pipeline as svgToImage()
+        // without loading). The request holds the arguments of aux::SvgToImage().
+        // Returns the request id (see cancel()).
+        function renderHandle(req) {
+            const id = track(req);
+            req.raw = req.output == RasterOutput.Pixels || req.output == RasterOutput.Encode;
+            req.t = stats ? { start: performance.now() } : null;
+            const loaded = handles.get(req.handle);
+            if (!loaded) { // released
+                failed(req, RasterError.NoInputData);
+                return id;
+            }
+            renderLoaded(req, loaded);
+            return id;
+        }
+
+        // Releases the handle. The pending renders are completed.
+        function releaseHandle(id) { handles.delete(id); }
+
+        Module.svg2img = {
+            svgToImage: svgToImage,
+            svgToTargets: svgToTargets,
+            mime: RasterMime,
+            createTexture: createTexture,
+            svgToTiles: svgToTiles,
+            svgToProgressive: svgToProgressive,
+            buildAtlas: buildAtlas,
+            loadHandle: loadHandle,
+            renderHandle: renderHandle,
+            releaseHandle: releaseHandle,
+            setStats: (enabled) => { stats = enabled; },
+            cancel: cancel,
+            setTimeout: setRequestTimeout,
+            setPool: setPool,
+            workerStats: workerStats,
+            setCanvasPool: setCanvasPool,
+            canvasStats: canvasStats,
+            setOutputArena: setOutputArena,
+            outputArenaStats: outputArenaStats,
+            setDeferred: setDeferred,
+            pumpCompletions: pumpCompletions,
+            queuedCompletions: () => completions.length,
+        };
+    });
+
+    // Loads svg to <img> for raster::SvgHandle (JS implementation).
+    // Svg is read synchronously. Returns the handle id.
+    EM_JS_INLINE(int, LoadHandle, (const char* data, std::size_t size, int input), {
+        return Module.svg2img.loadHandle({ data: data, size: size, input: input });
+    });
+
+    // Renders the loaded svg of raster::SvgHandle (JS implementation).
+    // The arguments are the same as for aux::SvgToImage(), but svg is the handle id.
+    // Returns the request id (see raster::Request).
+    EM_JS_INLINE(int, RenderHandle, (int handle, const void* pcb, void* meta,
+                                     const char* format, float quality,
+                                     float x, float y, float width, float height,
+                                     float zoom, int backend, int output,
+                                     EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx), {
+        // Format is cast to JS string for the same reason as in aux::SvgToImage().
+        return Module.svg2img.renderHandle({
+            handle: handle, pcb: pcb, meta: meta,
+            format: UTF8ToString(format), quality: quality,
+            x: x, y: y, width: width, height: height, zoom: zoom,
+            backend: backend, output: output, ctx: ctx,
+        });
+    });
+
+    // Releases raster::SvgHandle (JS implementation).
+    EM_JS_INLINE(void, ReleaseHandle, (int handle), {
+        Module.svg2img.releaseHandle(handle);
+    });
+
+    // Cancels the pending request with the error code (see raster::Request).
+    EM_JS_INLINE(void, CancelRequest, (int id, int err), {
+        Module.svg2img.cancel(id, err);
+    });
+
+    // Sets the timeout of the pending request (see raster::Request).
+    EM_JS_INLINE(void, SetRequestTimeout, (int id, double ms), {
+        Module.svg2img.setTimeout(id, ms);
+    });
+
+    // Uploads RGBA pixels (stride is width * 4) to a new texture of the WebGL context
+    // with the runtime (see createTexture()), so the native backend doesn't call GL from C++.
+    // Returns the texture name (0 on failure).
+    EM_JS_INLINE(unsigned int, UploadTexture, (EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx,
+                                               const std::uint8_t* rgba, int width, int height), {
+        return Module.svg2img.createTexture(ctx, (gl) => {
+            gl.texImage2D(gl.TEXTURE_2D, 0, gl.RGBA, width, height, 0, gl.RGBA, gl.UNSIGNED_BYTE,
+                          HEAPU8.subarray(rgba, rgba + width * height * 4)); // emsc
+        });
+    });
+
+    // Configures the worker pool (see raster::SetWorkerPool()).
+    EM_JS_INLINE(void, SetWorkerPool, (int size, int depth, double arena), {
+        Module.svg2img.setPool(size, depth, arena);
+    });
+
+    // Writes up to max worker stats (5 doubles each) to out (see raster::GetWorkerStats()).
+    // Returns the number of written entries.
+    EM_JS_INLINE(int, ReadWorkerStats, (double* out, int max), {
+        return Module.svg2img.workerStats(out, max);
+    });
+
+    // Sets the capacity of the canvas pool (see raster::SetCanvasPool()).
+    EM_JS_INLINE(void, SetCanvasPool, (int capacity), {
+        Module.svg2img.setCanvasPool(capacity);
+    });
+
+    // Writes the canvas pool stats (4 doubles) to out (see raster::GetCanvasPoolStats()).
+    EM_JS_INLINE(void, ReadCanvasPoolStats, (double* out), {
+        Module.svg2img.canvasStats(out);
+    });
+
+    // Reserves the output arena (see raster::SetOutputArena()).
+    EM_JS_INLINE(void, SetOutputArena, (double capacity), {
+        Module.svg2img.setOutputArena(capacity);
+    });
+
+    // Writes the output arena stats (4 doubles) to out (see raster::GetOutputArenaStats()).
+    EM_JS_INLINE(void, ReadOutputArenaStats, (double* out), {
+        Module.svg2img.outputArenaStats(out);
+    });
+
+    // Enables/disables the deferred completions (see raster::SetDeferredCompletions()).
+    EM_JS_INLINE(void, SetDeferredCompletions, (int enabled), {
+        Module.svg2img.setDeferred(enabled != 0);
+    });
+
+    // Runs the queued completions within the budget (see raster::PumpCompletions()).
+    // Returns the number of completions run.
+    EM_JS_INLINE(int, PumpCompletions, (double budget_ms), {
+        return Module.svg2img.pumpCompletions(budget_ms);
+    });
+
+    // Returns the number of queued completions.
+    EM_JS_INLINE(int, QueuedCompletions, (), {
+        return Module.svg2img.queuedCompletions();
+    });
+
+    // Enables/disables stats collection in the JS runtime.
+    EM_JS_INLINE(void, EnableStats, (int enabled), {
+        Module.svg2img.setStats(enabled != 0);
+    });
+
+    // Installs the JS runtime once per module.
+    inline void InitRuntime() {
+        static const bool inited = (InstallRuntime(), true);
+        (void) inited;
+    }
+
+    // Converts svg to raster image via the browser (JS implementation).
+    // Pcb type depends on the output (see aux::Output).
+    // Ctx is used only for textures.
+    // Returns the request id (see raster::Request).
+    EM_JS_INLINE(int, SvgToImage, (const char* data, std::size_t size, const void* pcb,
+                                    void* meta, const char* format, float quality,
+                                    float x, float y, float width, float height,
+                                    float zoom, int backend, int input, int output,
+                                    EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx), {
+        // 'format' may point to a temporary object. In this case, when the img.onload
+        // event occurs, this object will be destroyed, and we will get the dangling pointer.
+        // To prevent this, we are currently casting it to the JS string.
+        return Module.svg2img.svgToImage({
+            data: data, size: size, pcb: pcb, meta: meta,
+            format: UTF8ToString(format), quality: quality,
+            x: x, y: y, width: width, height: height, zoom: zoom,
+            backend: backend, input: input, output: output, ctx: ctx,
+        });
+    });
+
+    // Converts svg to raster image via the browser (JS implementation).
+    // The same as aux::SvgToImage(), but format is raster::Format, and the other arguments
+    // are read from opts (raster::Options).
+    EM_JS_INLINE(int, SvgToImageWith, (const char* data, std::size_t size, const void* pcb,
+                                       void* meta, int format, const Options* opts,
+                                       int backend, int input, int output), {
+        const p = opts >> 2;
+        return Module.svg2img.svgToImage({
+            data: data, size: size, pcb: pcb, meta: meta,
+            format: Module.svg2img.mime[format], quality: HEAPF32[p], // emsc
+            x: HEAPF32[p + 1], y: HEAPF32[p + 2], width: HEAPF32[p + 3], height: HEAPF32[p + 4],
+            zoom: HEAPF32[p + 5], backend: backend, input: input, output: output, ctx: 0,
+        });
+    });
+
+    // Converts svg given as chunks to raster image via the browser (JS implementation).
+    // The arguments are the same as for aux::SvgToImage(), but svg is count chunks,
+    // which are read as Blob parts before the function returns.
+    EM_JS_INLINE(int, SvgChunksToImage, (const SvgDesc* chunks, std::size_t count,
+                                         const void* pcb, void* meta,
+                                         const char* format, float quality,
+                                         float x, float y, float width, float height,
+                                         float zoom, int backend, int input, int output,
+                                         EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx), {
+        let list = [];
+        let size = 0;
+        for (let i = 0; i < count; ++i) {
+            const p = (chunks >> 2) + i * 2;
+            list.push({ data: HEAPU32[p], size: HEAPU32[p + 1] }); // emsc
+            size += HEAPU32[p + 1];
+        }
+        // Format is cast to JS string for the same reason as in aux::SvgToImage().
+        return Module.svg2img.svgToImage({
+            data: 0, size: size, chunks: list, pcb: pcb, meta: meta,
+            format: UTF8ToString(format), quality: quality,
+            x: x, y: y, width: width, height: height, zoom: zoom,
+            backend: backend, input: input, output: output, ctx: ctx,
+        });
+    });
+
+    // Converts svg to raster image split into tiles via the browser (JS implementation).
+    // Pcb is aux::PTileCallback. Returns the request id (see raster::Request).
+    EM_JS_INLINE(int, SvgToTiles, (const char* data, std::size_t size, const void* pcb,
+                                   void* meta, const char* format, float quality,
+                                   float width, float height, float zoom,
+                                   int tile_size, int input, int output), {
+        // Format is cast to JS string for the same reason as in aux::SvgToImage().
+        return Module.svg2img.svgToTiles({
+            data: data, size: size, pcb: pcb, meta: meta,
+            format: UTF8ToString(format), quality: quality,
+            x: 0, y: 0, width: width, height: height, zoom: zoom, tile_size: tile_size,
+            input: input, output: output,
+        });
+    });
+
+    // Converts svg to raster image with the preview via the browser (JS implementation).
+    // Pcb is aux::PProgressiveCallback. Returns the request id (see raster::Request).
+    EM_JS_INLINE(int, SvgToProgressive, (const char* data, std::size_t size, const void* pcb,
+                                         void* meta, const char* format, float quality,
+                                         float x, float y, float width, float height,
+                                         float zoom, int backend, int input, int output,
+                                         const char* preview_format, float preview_quality,
+                                         float preview_scale, double min_pixels), {
+        // Formats are cast to JS strings for the same reason as in aux::SvgToImage().
+        return Module.svg2img.svgToProgressive({
+            data: data, size: size, pcb: pcb, meta: meta,
+            format: UTF8ToString(format), quality: quality,
+            x: x, y: y, width: width, height: height, zoom: zoom,
+            backend: backend, input: input, output: output,
+            preview_format: UTF8ToString(preview_format), preview_quality: preview_quality,
+            preview_scale: preview_scale, min_pixels: min_pixels,
+        });
+    });
+
+    // Builds the sprite atlas via the browser (JS implementation).
+    // Pcb is aux::PAtlasRequest; ctx is used only for the texture atlas (0 - raw pixels).
+    // Returns the request id (see raster::Request).
+    EM_JS_INLINE(int, BuildAtlas, (const void* pcb, void* meta, const SvgDesc* svgs,
+                                   std::size_t count, float zoom, int input, int output,
+                                   EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx), {
+        let icons = [];
+        for (let i = 0; i < count; ++i) {
+            const p = (svgs >> 2) + i * 2;
+            icons.push({ data: HEAPU32[p], size: HEAPU32[p + 1], input: input, t: null });
+        }
+        return Module.svg2img.buildAtlas({
+            pcb: pcb, meta: meta, icons: icons,
+            x: 0, y: 0, width: 0, height: 0, zoom: zoom, input: input, output: output, ctx: ctx,
+        });
+    });
+
+    // Converts svg to many raster images via the browser (JS implementation).
+    // Each is a flag: call pcb (aux::PTargetCallback) per target;
+    // otherwise, call pcb (aux::PTargetsCallback) once for all targets.
+    EM_JS_INLINE(void, SvgToTargets, (const char* data, std::size_t size, const void* pcb,
+                                      void* meta, const TargetDesc* targets, std::size_t count,
+                                      int backend, int input, int each), {
+        // Formats are cast to JS strings for the same reason as in aux::SvgToImage().
+        let list = [];
+        for (let i = 0; i < count; ++i) {
+            const p = (targets >> 2) + i * 7;
+            list.push({ format: UTF8ToString(HEAPU32[p]), quality: HEAPF32[p + 1],
+                        x: HEAPF32[p + 2], y: HEAPF32[p + 3],
+                        width: HEAPF32[p + 4], height: HEAPF32[p + 5], zoom: HEAPF32[p + 6],
+                        raw: false });
+        }
+        Module.svg2img.svgToTargets({
+            data: data, size: size, pcb: pcb, meta: meta, targets: list,
+            backend: backend, input: input, each: each != 0,
+        });
+    });
+
+    // Executes the client's callback.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecCb(PCallback pcb,
+                                            const char *data, std::size_t size,
+                                            const Error err, void *meta) {
+        const Callback &cb = *pcb;
+        if (data != nullptr and size > 0) cb({data, size}, err, meta);
+        else cb(std::string_view(), err, meta);
+        delete pcb;
+    }
+
+    // Allocates the buffer for the buffer request.
+    // This function suits the call from JS.
+    extern "C"
+    inline void *EMSCRIPTEN_KEEPALIVE AllocBuffer(PBufferRequest preq, const std::size_t size) {
+        if (preq->alloc.alloc != nullptr) {
+            if (void *data = preq->alloc.alloc(size, preq->alloc.ctx)) {
+                preq->custom = true;
+                return data;
+            }
+        }
+        // fallback
+        return std::malloc(size);
+    }
+
+    // Frees the buffer allocated with malloc (see raster::ImageBuffer::Deleter).
+    inline void FreeBuffer(void *data, std::size_t, void *) { std::free(data); }
+
+    // Executes the client's buffer callback.
+    // The buffer ownership is passed to the callback.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecBufferCb(PBufferRequest preq,
+                                                  char *data, std::size_t size,
+                                                  const Error err, void *meta) {
+        const std::unique_ptr<BufferRequest> req(preq);
+        ImageBuffer img;
+        if (data != nullptr) {
+            if (req->custom) img = ImageBuffer(data, size, req->alloc.free, req->alloc.ctx);
+            else img = ImageBuffer(data, size, FreeBuffer, nullptr);
+        }
+        req->cb(std::move(img), err, meta);
+    }
+
+    // Completes the awaitable conversion and resumes the awaiting coroutine.
+    // The buffer ownership is passed to the awaitable.
+    // The state may be destroyed by the resumed coroutine, so we don't touch it after resume.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecAsyncCb(AsyncState *state,
+                                                 char *data, std::size_t size,
+                                                 const Error err, void *) {
+        if (data != nullptr) state->img = ImageBuffer(data, size, FreeBuffer, nullptr);
+        state->err = err;
+        if (state->pending == nullptr or --*state->pending == 0) state->handle.resume();
+    }
+
+    // Records the stage timings of the completed conversion.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE RecordSample(const double encode, const double load,
+                                                  const double draw, const double export_,
+                                                  const double read, const double copy,
+                                                  const double total,
+                                                  const std::size_t input_bytes,
+                                                  const std::size_t output_bytes,
+                                                  const Error err) {
+        const Sample sample{{encode, load, draw, export_, read, copy, total},
+                            input_bytes, output_bytes, err};
+        for (std::size_t i = 0; i < stage_count; ++i) {
+            if (sample.ms[i] >= 0.0) stats.stages[i].Add(sample.ms[i]);
+        }
+        ++stats.conversions;
+        if (err != Error::None) ++stats.failures;
+        stats.input_bytes += input_bytes;
+        stats.output_bytes += output_bytes;
+        if (stats_sink) stats_sink(sample);
+    }
+
+    // Executes the callable of the pending-request slot in place and frees the slot.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecSlotCb(const std::uint32_t idx,
+                                                const char *data, std::size_t size,
+                                                const Error err, void *meta) {
+        Slot &slot = slots[idx];
+        if (data != nullptr and size > 0) slot.invoke(slot, {data, size}, err, meta);
+        else slot.invoke(slot, std::string_view(), err, meta);
+        slots.Release(idx);
+    }
+
+    // Executes the client's pixel callback.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecPixelCb(PPixelCallback pcb,
+                                                 const char *data, std::size_t size,
+                                                 const int width, const int height,
+                                                 const Error err, void *meta) {
+        const PixelCallback &cb = *pcb;
+        Pixels px;
+        if (data != nullptr and size > 0) px = {{data, size}, width, height, width * 4};
+        cb(px, err, meta);
+        delete pcb;
+    }
+
+    // Executes the client's texture callback.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecTextureCb(PTextureCallback pcb, const unsigned int id,
+                                                   const int width, const int height,
+                                                   const Error err, void *meta) {
+        const TextureCallback &cb = *pcb;
+        cb(id != 0 ? Texture{id, width, height} : Texture(), err, meta);
+        delete pcb;
+    }
+
+    // Executes the client's tile callback.
+    // The callback is deleted after the last call.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecTileCb(PTileCallback pcb,
+                                                const char *data, std::size_t size,
+                                                const int col, const int row,
+                                                const int cols, const int rows,
+                                                const int x, const int y,
+                                                const int width, const int height,
+                                                const int stride, const Error err,
+                                                const int last, void *meta) {
+        const TileCallback &cb = *pcb;
+        Tile tile;
+        if (data != nullptr and size > 0) {
+            tile = {{data, size}, col, row, cols, rows, x, y, width, height, stride};
+        }
+        cb(tile, err, last != 0, meta);
+        if (last) delete pcb;
+    }
+
+    // Executes the client's progressive callback.
+    // The callback is deleted after the full output (preliminary is 0).
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecProgressiveCb(PProgressiveCallback pcb,
+                                                       const char *data, std::size_t size,
+                                                       const int width, const int height,
+                                                       const int stride, const Error err,
+                                                       const int preliminary, void *meta) {
+        const ProgressiveCallback &cb = *pcb;
+        Frame frame;
+        if (data != nullptr and size > 0) frame = {{data, size}, width, height, stride};
+        cb(frame, err, preliminary != 0, meta);
+        if (not preliminary) delete pcb;
+    }
+
+    // Packs the rects in the order into the strip of width x max_height with the skyline
+    // bottom-left heuristic: each rect rests on the skyline where its top is the lowest
+    // (the leftmost on ties). Sizes are read from the rects, positions are written to them.
+    // Rects that don't fit get Error::CanvasDrawingFailed. Returns true if all rects fit.
+    constexpr bool PackSkyline(std::vector<AtlasRect> &rects,
+                               const std::vector<std::size_t> &order,
+                               const int width, const int max_height, const int padding) {
+        struct Segment {
+            int x, y, width;
+        };
+        std::vector<Segment> skyline{{0, 0, width}};
+        bool all = true;
+        for (const std::size_t idx: order) {
+            AtlasRect &rect = rects[idx];
+            std::size_t best = skyline.size();
+            int best_y = 0, best_top = max_height + 1;
+            for (std::size_t i = 0; i < skyline.size(); ++i) {
+                const int x = skyline[i].x;
+                if (x + rect.width > width) break;
+                const int end = std::min(x + rect.width + padding, width);
+                int y = 0;
+                for (std::size_t j = i; j < skyline.size() and skyline[j].x < end; ++j) {
+                    y = std::max(y, skyline[j].y);
+                }
+                if (y + rect.height < best_top) {
+                    best = i;
+                    best_y = y;
+                    best_top = y + rect.height;
+                }
+            }
+            if (best == skyline.size()) {
+                rect.err = Error::CanvasDrawingFailed;
+                all = false;
+                continue;
+            }
+            rect.x = skyline[best].x;
+            rect.y = best_y;
+            rect.err = Error::None;
+            // The rect (with padding) replaces the covered segments.
+            const int end = std::min(rect.x + rect.width + padding, width);
+            std::size_t j = best;
+            while (j < skyline.size() and skyline[j].x + skyline[j].width <= end) ++j;
+            if (j < skyline.size() and skyline[j].x < end) {
+                skyline[j].width -= end - skyline[j].x;
+                skyline[j].x = end;
+            }
+            skyline.erase(skyline.begin() + best, skyline.begin() + j);
+            skyline.insert(skyline.begin() + best, {rect.x, best_y + rect.height + padding,
+                                                    end - rect.x});
+            for (std::size_t k = 0; k + 1 < skyline.size();) {
+                if (skyline[k].y == skyline[k + 1].y) {
+                    skyline[k].width += skyline[k + 1].width;
+                    skyline.erase(skyline.begin() + k + 1);
+                } else {
+                    ++k;
+                }
+            }
+        }
+        return all;
+    }
+
+    // Packs the rects into the atlas of up to max_size x max_size (see raster::BuildAtlas()).
+    // Sizes are read from the rects (their err is set if the icon failed to load),
+    // positions and texture coordinates are written to them (the rects that are not packed
+    // are reset to their err). The strip width starts at the power of two that fits
+    // the total area and doubles up to max_size until all rects fit.
+    // Returns the atlas size (0 x 0 if no rect is packed).
+    constexpr std::pair<int, int> PackRects(std::vector<AtlasRect> &rects, const int max_size,
+                                            const int padding) {
+        std::vector<std::size_t> order;
+        std::uint64_t area = 0;
+        int width = 1;
+        for (std::size_t i = 0; i < rects.size(); ++i) {
+            AtlasRect &rect = rects[i];
+            if (rect.err == Error::None and (rect.width <= 0 or rect.height <= 0)) {
+                rect.err = Error::ImgLoadingFailed;
+            }
+            if (rect.err != Error::None) continue;
+            if (rect.width > max_size or rect.height > max_size) {
+                rect.err = Error::CanvasDrawingFailed;
+                continue;
+            }
+            order.push_back(i);
+            area += static_cast<std::uint64_t>(rect.width + padding) * (rect.height + padding);
+            width = std::max(width, rect.width);
+        }
+        // Taller icons first: the skyline stays flat, and the gaps are small.
+        // Ties keep the input order.
+        std::sort(order.begin(), order.end(), [&rects](std::size_t a, std::size_t b) {
+            return rects[a].height > rects[b].height
+                   or (rects[a].height == rects[b].height and a < b);
+        });
+        int strip = 1;
+        while (strip < width or static_cast<std::uint64_t>(strip) * strip < area) strip *= 2;
+        strip = std::min(strip, max_size);
+        while (not PackSkyline(rects, order, strip, max_size, padding) and strip < max_size) {
+            strip = std::min(strip * 2, max_size);
+        }
+        int atlas_width = 0, atlas_height = 0;
+        for (const AtlasRect &rect: rects) {
+            if (rect.err != Error::None) continue;
+            atlas_width = std::max(atlas_width, rect.x + rect.width);
+            atlas_height = std::max(atlas_height, rect.y + rect.height);
+        }
+        for (AtlasRect &rect: rects) {
+            if (rect.err != Error::None) {
+                rect = {.err = rect.err};
+                continue;
+            }
+            rect.u0 = static_cast<float>(rect.x) / atlas_width;
+            rect.v0 = static_cast<float>(rect.y) / atlas_height;
+            rect.u1 = static_cast<float>(rect.x + rect.width) / atlas_width;
+            rect.v1 = static_cast<float>(rect.y + rect.height) / atlas_height;
+        }
+        return {atlas_width, atlas_height};
+    }
+
+    // Returns true if aux::PackRects() of the sizes packs the expected number of rects
+    // within max_size, the packed rects are apart by padding at least, and the rest
+    // are rejected with the error.
+    constexpr bool PacksApart(const std::vector<std::pair<int, int>> &sizes, const int max_size,
+                              const int padding, const std::size_t expected) {
+        std::vector<AtlasRect> rects;
+        for (const auto &[width, height]: sizes) {
+            rects.push_back({.width = width, .height = height});
+        }
+        const auto [atlas_width, atlas_height] = PackRects(rects, max_size, padding);
+        if (atlas_width > max_size or atlas_height > max_size) return false;
+        std::size_t packed = 0;
+        for (std::size_t i = 0; i < rects.size(); ++i) {
+            const AtlasRect &a = rects[i];
+            if (a.err != Error::None) {
+                const auto [width, height] = sizes[i];
+                const Error err = width <= 0 or height <= 0 ? Error::ImgLoadingFailed
+                                                            : Error::CanvasDrawingFailed;
+                if (a.err != err or a.width != 0 or a.height != 0) return false;
+                continue;
+            }
+            ++packed;
+            if (a.width != sizes[i].first or a.height != sizes[i].second or a.x < 0 or a.y < 0
+                or a.x + a.width > atlas_width or a.y + a.height > atlas_height) {
+                return false;
+            }
+            for (std::size_t j = 0; j < i; ++j) {
+                const AtlasRect &b = rects[j];
+                if (b.err != Error::None) continue;
+                if (a.x + a.width + padding > b.x and b.x + b.width + padding > a.x
+                    and a.y + a.height + padding > b.y and b.y + b.height + padding > a.y) {
+                    return false;
+                }
+            }
+        }
+        return packed == expected;
+    }
+
+    // The pseudo-random sizes that fit, the failed and oversized icons,
+    // and the equal squares that fill max_size (with padding, 4 of 9 fit).
+    static_assert(PacksApart({{0, 8}, {129, 4}, {4, 129}, {128, 1}}, 128, 0, 1));
+    static_assert([] {
+        std::vector<std::pair<int, int>> sizes;
+        std::uint32_t seed = 7;
+        for (int i = 0; i < 48; ++i) {
+            seed = seed * 1664525u + 1013904223u;
+            sizes.emplace_back(1 + (seed >> 8) % 40, 1 + (seed >> 20) % 40);
+        }
+        return PacksApart(sizes, 256, 2, sizes.size());
+    }());
+    static_assert(PacksApart(std::vector<std::pair<int, int>>(9, {60, 60}), 128, 2, 4));
+
+    // Packs the icons of the atlas request.
+    // Rects hold x, y, width, height per icon (int32), followed by the atlas size.
+    // JS sets the icon sizes (0 if the icon failed to load); we set the positions
+    // (the sizes of the icons that are not packed are reset to 0) and the atlas size
+    // (see aux::PackRects()). Returns 1 if any icon is packed.
+    // This function suits the call from JS.
+    extern "C"
+    inline int EMSCRIPTEN_KEEPALIVE PackAtlas(PAtlasRequest preq, int *rects,
+                                              const std::size_t count) {
+        std::vector<AtlasRect> &out = preq->atlas.rects;
+        for (std::size_t i = 0; i < count; ++i) {
+            out[i].width = rects[i * 4 + 2];
+            out[i].height = rects[i * 4 + 3];
+        }
+        const auto [atlas_width, atlas_height] = PackRects(out, preq->max_size, preq->padding);
+        for (std::size_t i = 0; i < count; ++i) {
+            const AtlasRect &rect = out[i];
+            rects[i * 4] = rect.x;
+            rects[i * 4 + 1] = rect.y;
+            rects[i * 4 + 2] = rect.width;
+            rects[i * 4 + 3] = rect.height;
+        }
+        preq->atlas.width = atlas_width;
+        preq->atlas.height = atlas_height;
+        rects[count * 4] = atlas_width;
+        rects[count * 4 + 1] = atlas_height;
+        return atlas_width > 0 ? 1 : 0;
+    }
+
+    // Executes the client's atlas callback.
+    // Data is the atlas pixels for the pixel atlas, id - the texture name for the texture one.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecAtlasCb(PAtlasRequest preq,
+                                                 const char *data, std::size_t size,
+                                                 const unsigned int id, const int width,
+                                                 const int height, const Error err, void *meta) {
+        Atlas &atlas = preq->atlas;
+        if (err != Error::None) atlas = Atlas();
+        else if (data != nullptr and size > 0) {
+            atlas.pixels = {{data, size}, width, height, width * 4};
+        }
+        else if (id != 0) atlas.texture = {id, width, height};
+        preq->cb(atlas, err, meta);
+        delete preq;
+    }
+
+    // Executes the client's target callback.
+    // The callback is deleted after the last target.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecTargetCb(PTargetCallback pcb, const std::size_t idx,
+                                                  const char *data, std::size_t size,
+                                                  const Error err, const int last, void *meta) {
+        if (data != nullptr and size > 0) (*pcb)(idx, {data, size}, err, meta);
+        else (*pcb)(idx, std::string_view(), err, meta);
+        if (last) delete pcb;
+    }
+
+    // Executes the client's targets callback.
+    // Data starts with the table of [offset, size, error] (uint32) per target;
+    // offsets are relative to data (see loadTargets() in JS).
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecTargetsCb(PTargetsCallback pcb, const char *data,
+                                                   const std::size_t count, void *meta) {
+        const auto *table = reinterpret_cast<const std::uint32_t *>(data);
+        std::vector<Result> results(count);
+        for (std::size_t i = 0; i < count; ++i) {
+            const std::uint32_t offset = table[i * 3], size = table[i * 3 + 1];
+            if (size > 0) results[i].img = {data + offset, size};
+            results[i].err = static_cast<Error>(table[i * 3 + 2]);
+        }
+        const TargetsCallback &cb = *pcb;
+        cb(results, meta);
+        delete pcb;
+    }
+
+    // Prepares targets for aux::SvgToTargets().
+    inline std::vector<TargetDesc> ToTargetDescs(const std::span<const Target> targets) {
+        std::vector<TargetDesc> descs;
+        descs.reserve(targets.size());
+        for (const Target &t : targets) {
+            assert(t.width >= 0 and t.height >= 0 and t.zoom > 0
+                   && "Wrong target arguments [raster::SvgToTargets()]");
+            descs.push_back({t.format.c_str(), t.quality, t.x, t.y, t.width, t.height, t.zoom});
+        }
+        return descs;
+    }
+
+    // Returns a fast 64-bit hash of the data (not cryptographic).
+    // Data is processed by 8 bytes with the multiply-xorshift mixing.
+    inline std::uint64_t Hash(const std::string_view data) {
+        constexpr std::uint64_t k = 0x9E3779B97F4A7C15ull;
+        const auto mix = [](std::uint64_t h) {
+            h ^= h >> 32;
+            h *= 0xD6E8FEB86659FD93ull;
+            h ^= h >> 32;
+            h *= 0xD6E8FEB86659FD93ull;
+            h ^= h >> 32;
+            return h;
+        };
+        std::uint64_t h = data.size() * k;
+        const char *p = data.data();
+        std::size_t n = data.size();
+        for (; n >= 8; p += 8, n -= 8) {
+            std::uint64_t w;
+            std::memcpy(&w, p, 8);
+            h = (h ^ mix(w)) * k;
+        }
+        if (n > 0) {
+            std::uint64_t w = 0;
+            std::memcpy(&w, p, n);
+            h = (h ^ mix(w)) * k;
+        }
+        return mix(h);
+    }
+
+    // Key of raster::Cache (and of the coalesced conversions).
+    // The png encoder and its level are the part of the key, since they change the output.
+    struct CacheKey {
+        std::uint64_t hash = 0;
+        std::size_t size = 0;
+        std::string format;
+        Encoder encoder = Encoder::Browser;
+        int level = 0; // See aux::EncoderLevel().
+        float quality, x, y, width, height, zoom;
+
+        bool operator==(const CacheKey &) const = default;
+    };
+
+    // Returns the key of the conversion with raster::SvgToImage() arguments
+    // (level is the same as for aux::EncoderLevel()).
+    inline CacheKey MakeCacheKey(const std::string_view svg, const std::string &format,
+                                 const float quality, const float x, const float y,
+                                 const float width, const float height, const float zoom,
+                                 const int level) {
+        return {Hash(svg), svg.size(), format, encoder, EncoderLevel(level),
+                quality, x, y, width, height, zoom};
+    }
+
+    struct CacheKeyHash {
+        std::size_t operator()(const CacheKey &key) const {
+            std::uint64_t h = key.hash ^ Hash(key.format);
+            h = (h ^ (static_cast<std::uint64_t>(key.encoder) << 32
+                      | static_cast<std::uint32_t>(key.level))) * 0x100000001B3ull;
+            for (const float f: {key.quality, key.x, key.y, key.width, key.height, key.zoom}) {
+                std::uint32_t bits;
+                std::memcpy(&bits, &f, sizeof(bits));
+                h = (h ^ bits) * 0x100000001B3ull;
+            }
+            return static_cast<std::size_t>(h);
+        }
+    };
+
+    // State of raster::Cache.
+    struct CacheState {
+        using Image = std::shared_ptr<const std::string>;
+        using Entry = std::pair<CacheKey, Image>;
+        using Lru = std::list<Entry>; // The most recently used entries go first.
+
+        Lru lru;
+        std::unordered_map<CacheKey, Lru::iterator, CacheKeyHash> index;
+        std::size_t budget = 0;
+        Cache::Delivery delivery = Cache::Delivery::Sync;
+        CacheStats stats;
+
+        // Returns the cached image (or nullptr) and marks it as recently used.
+        Image Find(const CacheKey &key) {
+            const auto it = index.find(key);
+            if (it == index.end()) return nullptr;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->second;
+        }
+
+        // Copies the image to the cache.
+        void Insert(const CacheKey &key, const std::string_view img) {
+            if (img.size() > budget or index.contains(key)) return;
+            lru.emplace_front(key, std::make_shared<const std::string>(img));
+            index.emplace(key, lru.begin());
+            stats.bytes += img.size();
+            ++stats.entries;
+            Evict();
+        }
+
+        // Evicts the least recently used entries while the budget is exceeded.
+        void Evict() {
+            while (stats.bytes > budget and not lru.empty()) {
+                stats.bytes -= lru.back().second->size();
+                --stats.entries;
+                ++stats.evictions;
+                index.erase(lru.back().first);
+                lru.pop_back();
+            }
+        }
+
+        void Clear() {
+            index.clear();
+            lru.clear();
+            stats.bytes = 0;
+            stats.entries = 0;
+        }
+    };
+
+    // Cache hit to deliver on the next tick.
+    struct CacheHit {
+        Callback cb;
+        CacheState::Image img;
+        void *meta;
+    };
+
+    // Delivers the cache hit (emscripten_async_call() callback).
+    inline void DeliverCacheHit(void *arg) {
+        const std::unique_ptr<CacheHit> hit(static_cast<CacheHit *>(arg));
+        hit->cb(*hit->img, Error::None, hit->meta);
+    }
+
+    // Callback attached to the in-flight conversion (see raster::SetCoalescing()).
+    // Its raster::Request has the negative id (-id), so it doesn't clash with JS request ids.
+    struct Waiter {
+        int id;
+        Callback cb;
+        void *meta;
+        unsigned timer = 0; // Generation of the latest timeout (see aux::SetWaiterTimeout()).
+    };
+
+    // In-flight conversion with the attached callbacks.
+    struct InFlight {
+        int request = 0; // Id of the JS request (0 until aux::Convert() returns).
+        std::vector<Waiter> waiters;
+    };
+
+    // In-flight conversions (key -> attached callbacks).
+    inline std::unordered_map<CacheKey, InFlight, CacheKeyHash> in_flight;
+    inline int next_waiter_id = 1;
+
+    // Calls back all waiters of the completed conversion.
+    // The entry is removed first, so the callbacks may start the same conversion anew.
+    inline void CompleteInFlight(const CacheKey &key, const std::string_view img, const Error err) {
+        auto node = in_flight.extract(key);
+        if (node.empty()) return;
+        for (const Waiter &waiter : node.mapped().waiters) waiter.cb(img, err, waiter.meta);
+    }
+
+    // Returns the waiter with the id (nullptr if its conversion is completed).
+    inline Waiter *FindWaiter(const int id) {
+        for (auto &[key, conversion] : in_flight) {
+            for (Waiter &waiter : conversion.waiters) {
+                if (waiter.id == id) return &waiter;
+            }
+        }
+        return nullptr;
+    }
+
+    // Detaches the waiter and calls it back with the error (see raster::Request::Cancel()).
+    // The conversion is cancelled only when no waiters remain. Completed waiters are ignored.
+    inline void DetachWaiter(const int id, const Error err) {
+        for (auto it = in_flight.begin(); it != in_flight.end(); ++it) {
+            std::vector<Waiter> &waiters = it->second.waiters;
+            const auto pos = std::find_if(waiters.begin(), waiters.end(),
+                                          [id](const Waiter &w) { return w.id == id; });
+            if (pos == waiters.end()) continue;
+            const Waiter waiter = std::move(*pos);
+            waiters.erase(pos);
+            if (waiters.empty()) {
+                // The entry goes first, so the cancelled conversion completes no one.
+                const int request = it->second.request;
+                in_flight.erase(it);
+                if (request != 0) CancelRequest(request, static_cast<int>(err));
+            }
+            waiter.cb(std::string_view(), err, waiter.meta);
+            return;
+        }
+    }
+
+    // Pending timeout of the waiter (emscripten_async_call() argument).
+    struct WaiterTimeout {
+        int id;
+        unsigned timer;
+    };
+
+    // Detaches the waiter with Error::Timeout unless the timeout was replaced
+    // (emscripten_async_call() callback).
+    inline void ExpireWaiter(void *arg) {
+        const std::unique_ptr<WaiterTimeout> timeout(static_cast<WaiterTimeout *>(arg));
+        const Waiter *waiter = FindWaiter(timeout->id);
+        if (waiter and waiter->timer == timeout->timer) DetachWaiter(timeout->id, Error::Timeout);
+    }
+
+    // Detaches the waiter with Error::Timeout in ms milliseconds
+    // (see raster::Request::SetTimeout()). Repeated calls replace the previous timeout.
+    inline void SetWaiterTimeout(const int id, const double ms) {
+        Waiter *waiter = FindWaiter(id);
+        if (not waiter) return;
+        emscripten_async_call(ExpireWaiter, new WaiterTimeout{id, ++waiter->timer},
+                              static_cast<int>(ms));
+    }
+
+    // Completes the batch job.
+    // This function suits the call from JS.
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecBatchCb(Batch *batch,
+                                                 const char *data, std::size_t size,
+                                                 const Error err, void *meta) {
+        const auto idx = reinterpret_cast<std::uintptr_t>(meta);
+        if (data != nullptr and size > 0) Complete(batch, idx, {data, size}, err);
+        else Complete(batch, idx, std::string_view(), err);
+    }
+
+    // Png encoder of the native backend.
+    // The image data is written as stored (uncompressed) deflate blocks, so the output size
+    // is known in advance, and the image is encoded in place without intermediate buffers.
+
+    constexpr std::array<std::uint32_t, 256> MakeCrcTable() {
+        std::array<std::uint32_t, 256> table{};
+        for (std::uint32_t n = 0; n < 256; ++n) {
+            std::uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }
+
+    inline constexpr std::array<std::uint32_t, 256> crc_table = MakeCrcTable();
+
+    constexpr std::uint32_t Crc32(const std::uint8_t *data, const std::size_t size) {
+        std::uint32_t c = 0xFFFFFFFFu;
+        for (std::size_t i = 0; i < size; ++i) c = crc_table[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+        return c ^ 0xFFFFFFFFu;
+    }
+
+    // Updates the Adler-32 sums (a, b) with data.
+    // The modulo is deferred for 5552 bytes (the max run without overflow).
+    constexpr void Adler32(std::uint32_t &a, std::uint32_t &b,
+                           const std::uint8_t *data, std::size_t size) {
+        while (size > 0) {
+            const std::size_t n = std::min<std::size_t>(size, 5552);
+            for (std::size_t i = 0; i < n; ++i) {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            data += n;
+            size -= n;
+        }
+    }
+
+    // Check values of the png spec (the IEND crc) and RFC 1950 (the Adler-32 of "Wikipedia").
+    static_assert([] {
+        constexpr std::uint8_t iend[] = {'I', 'E', 'N', 'D'};
+        return Crc32(iend, sizeof iend);
+    }() == 0xAE426082u);
+    static_assert([] {
+        constexpr std::uint8_t text[] = {'W', 'i', 'k', 'i', 'p', 'e', 'd', 'i', 'a'};
+        std::uint32_t a = 1, b = 0;
+        Adler32(a, b, text, sizeof text);
+        return b << 16 | a;
+    }() == 0x11E60398u);
+
+    // Returns the size of the png image encoded with aux::EncodePng().
+    constexpr std::size_t PngSize(const int width, const int height) {
+        const std::size_t raw = static_cast<std::size_t>(height)
+                                * (static_cast<std::size_t>(width) * 4 + 1);
+        const std::size_t blocks = std::max<std::size_t>(1, (raw + 65534) / 65535);
+        // signature, IHDR, IDAT (zlib header, blocks, adler), IEND
+        return 8 + 25 + 12 + 2 + raw + 5 * blocks + 4 + 12;
+    }
+    static_assert(PngSize(1, 1) == 73 and PngSize(16384, 1) == 65610); // 65537 bytes, 2 blocks
+
+    // Encodes RGBA pixels (stride is width * 4) to png.
+    // Out should hold aux::PngSize() bytes.
+    inline void EncodePng(const std::uint8_t *rgba, const int width, const int height, char *out) {
+        const std::size_t row = static_cast<std::size_t>(width) * 4;
+        const std::size_t raw = static_cast<std::size_t>(height) * (row + 1);
+        auto *p = reinterpret_cast<std::uint8_t *>(out);
+        const auto be32 = [&p](const std::uint32_t val) {
+            *p++ = val >> 24;
+            *p++ = val >> 16;
+            *p++ = val >> 8;
+            *p++ = val;
+        };
+        const auto begin_chunk = [&p, &be32](const std::uint32_t size, const char *type) {
+            be32(size);
+            std::memcpy(p, type, 4);
+            return std::exchange(p, p + 4);
+        };
+        const auto end_chunk = [&p, &be32](const std::uint8_t *type) {
+            be32(Crc32(type, p - type));
+        };
+        std::memcpy(p, "\x89PNG\r\n\x1A\n", 8);
+        p += 8;
+        // IHDR: 8-bit RGBA, deflate, no filter, no interlace
+        const std::uint8_t *type = begin_chunk(13, "IHDR");
+        be32(width);
+        be32(height);
+        const std::uint8_t ihdr[] = {8, 6, 0, 0, 0};
+        std::memcpy(p, ihdr, sizeof ihdr);
+        p += sizeof ihdr;
+        end_chunk(type);
+        // IDAT: zlib stream of the rows, each prefixed with the filter type (none)
+        type = begin_chunk(PngSize(width, height) - 8 - 25 - 12 - 12, "IDAT");
+        *p++ = 0x78; // deflate, 32K window
+        *p++ = 0x01; // no dictionary, fastest compression
+        std::uint32_t a = 1, b = 0;
+        std::size_t y = 0, x = 0; // position in the raw stream (x = 0 is the filter type)
+        std::size_t left = raw;
+        do {
+            const std::size_t n = std::min<std::size_t>(left, 65535);
+            left -= n;
+            const std::uint8_t header[] = {
+                static_cast<std::uint8_t>(left == 0), // BFINAL, BTYPE = 00 (stored)
+                static_cast<std::uint8_t>(n), static_cast<std::uint8_t>(n >> 8),
+                static_cast<std::uint8_t>(~n), static_cast<std::uint8_t>(~n >> 8)
+            };
+            std::memcpy(p, header, sizeof header);
+            p += sizeof header;
+            const std::uint8_t *block = p;
+            for (std::size_t k = n; k > 0;) {
+                std::size_t m = 1;
+                if (x == 0) *p = 0;
+                else {
+                    m = std::min(k, row + 1 - x);
+                    std::memcpy(p, rgba + y * row + (x - 1), m);
+                }
+                p += m;
+                x += m;
+                k -= m;
+                if (x == row + 1) {
+                    x = 0;
+                    ++y;
+                }
+            }
+            Adler32(a, b, block, n);
+        } while (left > 0);
+        be32(b << 16 | a);
+        end_chunk(type);
+        // IEND
+        type = begin_chunk(0, "IEND");
+        end_chunk(type);
+    }
+
+    // Png encoder of raster::Encoder::Wasm.
+    // Each row is filtered (see the png spec, 9.2) and the filtered stream is compressed
+    // with LZ77 (hash chains, 32K window) and Huffman coding (RFC 1951).
+    // The level selects the row filter and the match search effort.
+
+    // Writes bits to the deflate stream (LSB first).
+    class BitWriter {
+    public:
+        explicit constexpr BitWriter(std::vector<std::uint8_t> &out) : out_(out) {}
+
+        // Writes the lowest n bits of val.
+        constexpr void Put(const std::uint32_t val, const int n) {
+            acc_ |= static_cast<std::uint64_t>(val) << count_;
+            count_ += n;
+            while (count_ >= 8) {
+                out_.push_back(static_cast<std::uint8_t>(acc_));
+                acc_ >>= 8;
+                count_ -= 8;
+            }
+        }
+
+        // Writes the Huffman code of n bits (codes are packed MSB first).
+        constexpr void PutCode(const std::uint32_t code, const int n) {
+            std::uint32_t rev = 0;
+            for (int i = 0; i < n; ++i) rev |= (code >> i & 1) << (n - 1 - i);
+            Put(rev, n);
+        }
+
+        // Writes the bytes after aux::BitWriter::Flush().
+        constexpr void PutBytes(const std::uint8_t *data, const std::size_t size) {
+            out_.insert(out_.end(), data, data + size);
+        }
+
+        // Writes the pending bits padded to the byte boundary.
+        constexpr void Flush() {
+            if (count_ > 0) out_.push_back(static_cast<std::uint8_t>(acc_));
+            acc_ = 0;
+            count_ = 0;
+        }
+
+    private:
+        std::vector<std::uint8_t> &out_;
+        std::uint64_t acc_ = 0;
+        int count_ = 0;
+    };
+
+    // Base values and extra bits of the deflate length codes (257..285) and distance codes.
+    inline constexpr std::uint16_t length_base[] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    inline constexpr std::uint8_t length_extra[] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    inline constexpr std::uint16_t distance_base[] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+    };
+    inline constexpr std::uint8_t distance_extra[] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+
+    // Each code covers the lengths (distances) up to the base of the next one;
+    // 284 stops at 257, and the length 258 has its own code 285.
+    static_assert([] {
+        for (std::size_t i = 0; i + 1 < std::size(length_base); ++i) {
+            const std::uint32_t end = length_base[i] + (1u << length_extra[i]);
+            if (end != length_base[i + 1] + (i + 2 == std::size(length_base) ? 1u : 0u)) {
+                return false;
+            }
+        }
+        for (std::size_t i = 0; i + 1 < std::size(distance_base); ++i) {
+            if (distance_base[i] + (1u << distance_extra[i]) != distance_base[i + 1]) return false;
+        }
+        return distance_base[29] + (1u << distance_extra[29]) == 32769;
+    }());
+
+    // Order of the code length code lengths (RFC 1951, 3.2.7).
+    inline constexpr std::uint8_t cl_order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+
+    // LZ77 token: a literal (dist is 0) or a match (length 3..258, distance 1..32768).
+    struct Token {
+        std::uint16_t value;
+        std::uint16_t dist;
+    };
+
+    // Returns the length code of the match (the symbol - 257).
+    constexpr std::size_t LengthCode(const std::uint32_t length) {
+        return std::upper_bound(std::begin(length_base), std::end(length_base), length)
+               - std::begin(length_base) - 1;
+    }
+
+    // Returns the distance code of the match.
+    constexpr std::size_t DistanceCode(const std::uint32_t distance) {
+        return std::upper_bound(std::begin(distance_base), std::end(distance_base), distance)
+               - std::begin(distance_base) - 1;
+    }
+    static_assert(LengthCode(3) == 0 and LengthCode(10) == 7 and LengthCode(11) == 8
+                  and LengthCode(12) == 8 and LengthCode(257) == 27 and LengthCode(258) == 28);
+    static_assert(DistanceCode(1) == 0 and DistanceCode(4) == 3 and DistanceCode(5) == 4
+                  and DistanceCode(24576) == 28 and DistanceCode(32768) == 29);
+
+    // Builds the Huffman code lengths (up to max_bits) for the symbol frequencies.
+    // Unused symbols get the zero length. If the tree is too deep, the frequencies are
+    // halved until it fits (simpler than package-merge and close enough for deflate).
+    constexpr void BuildLengths(const std::uint32_t *freqs, const std::size_t count,
+                                const int max_bits, std::uint8_t *lengths) {
+        std::fill(lengths, lengths + count, 0);
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> leaves; // (frequency, symbol)
+        for (std::size_t s = 0; s < count; ++s) {
+            if (freqs[s] > 0) leaves.emplace_back(freqs[s], static_cast<std::uint32_t>(s));
+        }
+        if (leaves.empty()) return;
+        if (leaves.size() == 1) {
+            lengths[leaves[0].second] = 1;
+            return;
+        }
+        const std::size_t n = leaves.size();
+        std::vector<std::uint64_t> weight(2 * n - 1);
+        std::vector<std::size_t> parent(2 * n - 1);
+        std::vector<std::uint8_t> depth(2 * n - 1);
+        for (;;) {
+            std::sort(leaves.begin(), leaves.end());
+            for (std::size_t i = 0; i < n; ++i) weight[i] = leaves[i].first;
+            // Two-queue construction: both the leaves and the merged nodes are sorted by weight.
+            std::size_t leaf = 0, node = n, next = n;
+            const auto pick = [&]() {
+                if (leaf < n and (node == next or weight[leaf] <= weight[node])) return leaf++;
+                return node++;
+            };
+            for (; next < 2 * n - 1; ++next) {
+                const std::size_t a = pick(), b = pick();
+                weight[next] = weight[a] + weight[b];
+                parent[a] = parent[b] = next;
+            }
+            // Parents are created after the children, so depths are filled downwards.
+            int max_depth = 0;
+            depth[2 * n - 2] = 0;
+            for (std::size_t i = 2 * n - 2; i-- > 0;) {
+                depth[i] = depth[parent[i]] + 1;
+                max_depth = std::max<int>(max_depth, depth[i]);
+            }
+            if (max_depth <= max_bits) break;
+            for (auto &[freq, symbol]: leaves) freq = (freq + 1) / 2;
+        }
+        for (std::size_t i = 0; i < n; ++i) lengths[leaves[i].second] = depth[i];
+    }
+
+    // Assigns the canonical Huffman codes to the code lengths (RFC 1951, 3.2.2).
+    constexpr void BuildCodes(const std::uint8_t *lengths, const std::size_t count,
+                              std::uint16_t *codes) {
+        std::uint16_t bl_count[16] = {}, next_code[16] = {};
+        for (std::size_t s = 0; s < count; ++s) {
+            if (lengths[s] > 0) ++bl_count[lengths[s]];
+        }
+        std::uint16_t code = 0;
+        for (int bits = 1; bits < 16; ++bits) {
+            code = (code + bl_count[bits - 1]) << 1;
+            next_code[bits] = code;
+        }
+        for (std::size_t s = 0; s < count; ++s) {
+            if (lengths[s] > 0) codes[s] = next_code[lengths[s]]++;
+        }
+    }
+
+    // The example of RFC 1951, 3.2.2: lengths (3, 3, 3, 3, 3, 2, 4, 4) give the codes
+    // 010, 011, 100, 101, 110, 00, 1110, 1111.
+    static_assert([] {
+        constexpr std::uint8_t lengths[] = {3, 3, 3, 3, 3, 2, 4, 4};
+        constexpr std::uint16_t expected[] = {2, 3, 4, 5, 6, 0, 14, 15};
+        std::uint16_t codes[8] = {};
+        BuildCodes(lengths, 8, codes);
+        return std::equal(std::begin(codes), std::end(codes), std::begin(expected));
+    }());
+
+    // Fibonacci frequencies make the deepest tree (20 levels), so the lengths are limited;
+    // the code stays complete (the Kraft sum is 1) and keeps the unused symbol out.
+    static_assert([] {
+        std::uint32_t freqs[22] = {1, 1};
+        for (std::size_t s = 2; s < 21; ++s) freqs[s] = freqs[s - 1] + freqs[s - 2];
+        std::uint8_t lengths[22] = {};
+        BuildLengths(freqs, 22, 7, lengths);
+        std::uint32_t kraft = 0;
+        for (std::size_t s = 0; s < 21; ++s) {
+            if (lengths[s] == 0 or lengths[s] > 7) return false;
+            kraft += 1u << (7 - lengths[s]);
+        }
+        return kraft == 1u << 7 and lengths[21] == 0;
+    }());
+
+    // Writes the tokens as a deflate block: stored, fixed, or dynamic Huffman,
+    // whichever is the smallest. Data is the uncompressed bytes of the block.
+    constexpr void PutBlock(BitWriter &bits, const std::vector<Token> &tokens,
+                            const std::uint8_t *data, const std::size_t size, const bool last) {
+        std::uint32_t lit_freq[286] = {}, dist_freq[30] = {};
+        std::uint64_t extra = 0; // extra bits of the matches, the same for both Huffman blocks
+        for (const Token &t: tokens) {
+            if (t.dist == 0) {
+                ++lit_freq[t.value];
+                continue;
+            }
+            const std::size_t l = LengthCode(t.value), d = DistanceCode(t.dist);
+            ++lit_freq[257 + l];
+            ++dist_freq[d];
+            extra += length_extra[l] + distance_extra[d];
+        }
+        lit_freq[256] = 1; // end of block
+        // Fixed codes (RFC 1951, 3.2.6) are the canonical codes of the fixed lengths.
+        std::uint8_t fixed_lit[288], fixed_dist[30];
+        std::fill(fixed_lit, fixed_lit + 144, 8);
+        std::fill(fixed_lit + 144, fixed_lit + 256, 9);
+        std::fill(fixed_lit + 256, fixed_lit + 280, 7);
+        std::fill(fixed_lit + 280, fixed_lit + 288, 8);
+        std::fill(std::begin(fixed_dist), std::end(fixed_dist), 5);
+        std::uint8_t lit_len[286], dist_len[30];
+        BuildLengths(lit_freq, 286, 15, lit_len);
+        BuildLengths(dist_freq, 30, 15, dist_len);
+        if (std::all_of(std::begin(dist_len), std::end(dist_len), [](auto l) { return l == 0; })) {
+            dist_len[0] = 1; // at least one distance code is required
+        }
+        std::size_t hlit = 286, hdist = 30;
+        while (hlit > 257 and lit_len[hlit - 1] == 0) --hlit;
+        while (hdist > 1 and dist_len[hdist - 1] == 0) --hdist;
+        // Code lengths of both trees, run-length encoded with the symbols 16..18.
+        std::vector<std::uint8_t> all(lit_len, lit_len + hlit);
+        all.insert(all.end(), dist_len, dist_len + hdist);
+        std::vector<std::pair<std::uint8_t, std::uint8_t>> runs; // (symbol, extra value)
+        std::uint32_t cl_freq[19] = {};
+        for (std::size_t i = 0; i < all.size();) {
+            const std::uint8_t v = all[i];
+            std::size_t run = 1;
+            while (i + run < all.size() and all[i + run] == v) ++run;
+            if (v == 0 and run >= 3) {
+                run = std::min<std::size_t>(run, 138);
+                if (run >= 11) runs.emplace_back(18, run - 11);
+                else runs.emplace_back(17, run - 3);
+                i += run;
+            } else if (v != 0 and run >= 4) {
+                run = std::min<std::size_t>(run - 1, 6);
+                runs.emplace_back(v, 0);
+                runs.emplace_back(16, run - 3);
+                i += run + 1;
+            } else {
+                runs.emplace_back(v, 0);
+                ++i;
+            }
+        }
+        for (const auto &[sym, val]: runs) ++cl_freq[sym];
+        constexpr std::uint8_t cl_extra[19] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 3, 7
+        };
+        std::uint8_t cl_len[19];
+        BuildLengths(cl_freq, 19, 7, cl_len);
+        std::size_t hclen = 19;
+        while (hclen > 4 and cl_len[cl_order[hclen - 1]] == 0) --hclen;
+        // Sizes of the block types (in bits).
+        std::uint64_t fixed_bits = 3 + extra, dynamic_bits = 3 + 14 + 3 * hclen + extra;
+        for (std::size_t s = 0; s < 286; ++s) {
+            fixed_bits += static_cast<std::uint64_t>(lit_freq[s]) * fixed_lit[s];
+            dynamic_bits += static_cast<std::uint64_t>(lit_freq[s]) * lit_len[s];
+        }
+        for (std::size_t d = 0; d < 30; ++d) {
+            fixed_bits += static_cast<std::uint64_t>(dist_freq[d]) * fixed_dist[d];
+            dynamic_bits += static_cast<std::uint64_t>(dist_freq[d]) * dist_len[d];
+        }
+        for (const auto &[sym, val]: runs) dynamic_bits += cl_len[sym] + cl_extra[sym];
+        const std::size_t stored_blocks = std::max<std::size_t>(1, (size + 65534) / 65535);
+        const std::uint64_t stored_bits = (size + 5 * stored_blocks) * 8 + 7;
+        if (stored_bits < std::min(fixed_bits, dynamic_bits)) {
+            std::size_t left = size;
+            do {
+                const std::size_t n = std::min<std::size_t>(left, 65535);
+                left -= n;
+                bits.Put(last and left == 0, 1);
+                bits.Put(0, 2); // BTYPE = 00 (stored)
+                bits.Flush();
+                bits.Put(static_cast<std::uint32_t>(n), 16);
+                bits.Put(static_cast<std::uint32_t>(~n & 0xFFFF), 16);
+                bits.PutBytes(data, n);
+                data += n;
+            } while (left > 0);
+            return;
+        }
+        const bool fixed = fixed_bits <= dynamic_bits;
+        const std::uint8_t *lens = fixed ? fixed_lit : lit_len;
+        const std::uint8_t *dlens = fixed ? fixed_dist : dist_len;
+        std::uint16_t lit_code[288] = {}, dist_code[30] = {};
+        BuildCodes(lens, fixed ? 288 : 286, lit_code);
+        BuildCodes(dlens, 30, dist_code);
+        bits.Put(last, 1);
+        bits.Put(fixed ? 1 : 2, 2); // BTYPE = 01 (fixed Huffman) or 10 (dynamic Huffman)
+        if (not fixed) {
+            std::uint16_t cl_code[19] = {};
+            BuildCodes(cl_len, 19, cl_code);
+            bits.Put(static_cast<std::uint32_t>(hlit - 257), 5);
+            bits.Put(static_cast<std::uint32_t>(hdist - 1), 5);
+            bits.Put(static_cast<std::uint32_t>(hclen - 4), 4);
+            for (std::size_t i = 0; i < hclen; ++i) bits.Put(cl_len[cl_order[i]], 3);
+            for (const auto &[sym, val]: runs) {
+                bits.PutCode(cl_code[sym], cl_len[sym]);
+                bits.Put(val, cl_extra[sym]);
+            }
+        }
+        for (const Token &t: tokens) {
+            if (t.dist == 0) {
+                bits.PutCode(lit_code[t.value], lens[t.value]);
+                continue;
+            }
+            const std::size_t l = LengthCode(t.value), d = DistanceCode(t.dist);
+            bits.PutCode(lit_code[257 + l], lens[257 + l]);
+            bits.Put(t.value - length_base[l], length_extra[l]);
+            bits.PutCode(dist_code[d], dlens[d]);
+            bits.Put(t.dist - distance_base[d], distance_extra[d]);
+        }
+        bits.PutCode(lit_code[256], lens[256]); // end of block
+    }
+
+    // Compresses data to the deflate stream.
+    // Level 1..9 sets the max length of the hash chains (1 << (level - 1) candidates)
+    // and the length of the match that stops the search; levels 4..9 also defer the match
+    // by one byte if the next one is longer (lazy matching). Each block of tokens is written
+    // with the smallest block type (see aux::PutBlock()). The hash tables are scaled down
+    // for the inputs smaller than the window (e.g., small tiles), so they are cheap to clear.
+    constexpr void Deflate(const std::uint8_t *data, const std::size_t size, const int level,
+                           std::vector<std::uint8_t> &out) {
+        constexpr std::size_t window = 32768;
+        const auto hash_size = static_cast<std::uint32_t>(
+            std::bit_ceil(std::clamp<std::size_t>(size, 256, window)));
+        constexpr std::size_t block_tokens = 16384;
+        const int max_chain = 1 << (std::clamp(level, 1, 9) - 1);
+        const std::size_t nice = level <= 3 ? 32 : level <= 6 ? 128 : 258;
+        const bool lazy = level >= 4;
+        // Positions are below the window size for smaller inputs, so prev needs only size.
+        std::vector<std::int32_t> head(hash_size, -1), prev(std::min(size, window), -1);
+        const auto hash = [data, hash_size](const std::size_t i) {
+            return (static_cast<std::uint32_t>(data[i]) << 10
+                    ^ static_cast<std::uint32_t>(data[i + 1]) << 5 ^ data[i + 2]) & (hash_size - 1);
+        };
+        const auto insert = [&](const std::size_t i) {
+            const std::uint32_t h = hash(i);
+            prev[i & (window - 1)] = head[h];
+            head[h] = static_cast<std::int32_t>(i);
+        };
+        std::size_t inserted = 0; // the next position to insert into the hash chains
+        // Returns the length of the longest match at i (0 if none) and inserts i.
+        const auto find = [&](const std::size_t i, std::size_t &best_dist) {
+            std::size_t best_len = 0;
+            if (i + 3 > size) return best_len;
+            const std::size_t max_len = std::min<std::size_t>(258, size - i);
+            std::int32_t cand = head[hash(i)];
+            for (int chain = max_chain; cand >= 0 and chain > 0; --chain) {
+                const std::size_t dist = i - cand;
+                if (dist > window) break;
+                // Chains may hold stale positions, so candidates are always compared.
+                if (data[cand + best_len] == data[i + best_len]) {
+                    std::size_t len = 0;
+                    while (len < max_len and data[cand + len] == data[i + len]) ++len;
+                    if (len > best_len) {
+                        best_len = len;
+                        best_dist = dist;
+                        if (len >= nice or len == max_len) break;
+                    }
+                }
+                cand = prev[cand & (window - 1)];
+            }
+            insert(i);
+            inserted = i + 1;
+            return best_len;
+        };
+        BitWriter bits(out);
+        std::vector<Token> tokens;
+        tokens.reserve(block_tokens + 2);
+        std::size_t block_start = 0;
+        std::size_t i = 0;
+        while (i < size) {
+            std::size_t dist = 0;
+            std::size_t len = find(i, dist);
+            while (lazy and len >= 3 and len < nice) {
+                std::size_t next_dist = 0;
+                const std::size_t next_len = find(i + 1, next_dist);
+                if (next_len <= len) break;
+                tokens.push_back({data[i], 0});
+                ++i;
+                len = next_len;
+                dist = next_dist;
+            }
+            if (len >= 3) {
+                tokens.push_back({static_cast<std::uint16_t>(len),
+                                  static_cast<std::uint16_t>(dist)});
+                for (; inserted < i + len and inserted + 3 <= size; ++inserted) insert(inserted);
+                i += len;
+                inserted = std::max(inserted, i);
+            } else {
+                tokens.push_back({data[i], 0});
+                ++i;
+            }
+            if (tokens.size() >= block_tokens) {
+                PutBlock(bits, tokens, data + block_start, i - block_start, false);
+                tokens.clear();
+                block_start = i;
+            }
+        }
+        PutBlock(bits, tokens, data + block_start, i - block_start, true);
+        bits.Flush();
+    }
+
+    // Decodes the deflate stream to out (appended). Returns false if the stream is malformed.
+    // This is the reference decoder for the compile-time checks of aux::Deflate() below
+    // (slow bit-by-bit Huffman decoding), it isn't used at run time.
+    constexpr bool Inflate(const std::uint8_t *data, const std::size_t size,
+                           std::vector<std::uint8_t> &out) {
+        std::size_t pos = 0; // in bits
+        bool ok = true;
+        const auto get = [&](const int n) {
+            std::uint32_t val = 0;
+            for (int i = 0; i < n; ++i, ++pos) {
+                if (pos >= size * 8) ok = false;
+                else val |= static_cast<std::uint32_t>(data[pos / 8] >> pos % 8 & 1) << i;
+            }
+            return val;
+        };
+        // Canonical code: the symbols sorted by the code length (see aux::BuildCodes()).
+        struct Code {
+            std::uint16_t count[16] = {};
+            std::uint16_t symbols[288] = {};
+        };
+        const auto build = [](const std::uint8_t *lengths, const std::size_t n) {
+            Code code;
+            for (std::size_t s = 0; s < n; ++s) ++code.count[lengths[s]];
+            std::uint16_t offsets[16] = {};
+            for (int bits = 2; bits < 16; ++bits) {
+                offsets[bits] = offsets[bits - 1] + code.count[bits - 1];
+            }
+            for (std::size_t s = 0; s < n; ++s) {
+                if (lengths[s] > 0) code.symbols[offsets[lengths[s]]++] = s;
+            }
+            return code;
+        };
+        const auto decode = [&](const Code &code) {
+            int value = 0, first = 0, index = 0;
+            for (int bits = 1; bits < 16 and ok; ++bits) {
+                value |= static_cast<int>(get(1));
+                const int count = code.count[bits];
+                if (value - first < count) return int{code.symbols[index + value - first]};
+                index += count;
+                first = (first + count) << 1;
+                value <<= 1;
+            }
+            ok = false;
+            return -1;
+        };
+        for (bool last = false; not last and ok;) {
+            last = get(1) != 0;
+            const std::uint32_t type = get(2);
+            if (type == 0) { // stored
+                pos = (pos + 7) / 8 * 8;
+                const std::uint32_t n = get(16), nn = get(16);
+                if (not ok or n != (~nn & 0xFFFF) or pos / 8 + n > size) return false;
+                out.insert(out.end(), data + pos / 8, data + pos / 8 + n);
+                pos += n * 8;
+                continue;
+            }
+            if (type == 3) return false;
+            std::uint8_t lengths[288 + 32] = {};
+            std::size_t hlit = 288, hdist = 30;
+            if (type == 1) { // fixed Huffman (RFC 1951, 3.2.6)
+                std::fill(lengths, lengths + 144, 8);
+                std::fill(lengths + 144, lengths + 256, 9);
+                std::fill(lengths + 256, lengths + 280, 7);
+                std::fill(lengths + 280, lengths + 288, 8);
+                std::fill(lengths + 288, lengths + 318, 5);
+            } else { // dynamic Huffman
+                hlit = get(5) + 257;
+                hdist = get(5) + 1;
+                const std::size_t hclen = get(4) + 4;
+                std::uint8_t cl_len[19] = {};
+                for (std::size_t i = 0; i < hclen; ++i) cl_len[cl_order[i]] = get(3);
+                const Code cl = build(cl_len, 19);
+                for (std::size_t i = 0; i < hlit + hdist and ok;) {
+                    const int sym = decode(cl);
+                    if (sym < 0) return false;
+                    if (sym < 16) {
+                        lengths[i++] = static_cast<std::uint8_t>(sym);
+                        continue;
+                    }
+                    if (sym == 16 and i == 0) return false;
+                    const std::uint8_t len = sym == 16 ? lengths[i - 1] : 0;
+                    const std::size_t run = sym == 16 ? 3 + get(2) : sym == 17 ? 3 + get(3)
+                                                                            : 11 + get(7);
+                    if (i + run > hlit + hdist) return false;
+                    for (std::size_t k = 0; k < run; ++k) lengths[i++] = len;
+                }
+            }
+            const Code lit = build(lengths, hlit), dist = build(lengths + hlit, hdist);
+            for (;;) {
+                const int sym = decode(lit);
+                if (sym < 0 or sym > 285) return false;
+                if (sym < 256) {
+                    out.push_back(static_cast<std::uint8_t>(sym));
+                    continue;
+                }
+                if (sym == 256) break; // end of block
+                const std::size_t l = sym - 257;
+                const std::size_t len = length_base[l] + get(length_extra[l]);
+                const int d = decode(dist);
+                if (d < 0 or d >= 30) return false;
+                const std::size_t distance = distance_base[d] + get(distance_extra[d]);
+                if (not ok or distance > out.size()) return false;
+                for (std::size_t k = 0; k < len; ++k) {
+                    const std::uint8_t byte = out[out.size() - distance];
+                    out.push_back(byte);
+                }
+            }
+        }
+        return ok;
+    }
+
+    // Returns true if aux::Deflate() of data at the level inflates back to data.
+    constexpr bool RoundTrips(const std::vector<std::uint8_t> &data, const int level) {
+        std::vector<std::uint8_t> packed, unpacked;
+        Deflate(data.data(), data.size(), level, packed);
+        return Inflate(packed.data(), packed.size(), unpacked) and unpacked == data;
+    }
+
+    // Returns the bytes of the text repeated n times with the counter after each copy,
+    // so the matches are long but not the whole input.
+    constexpr std::vector<std::uint8_t> RepeatedText(const std::string_view text,
+                                                     const std::size_t n) {
+        std::vector<std::uint8_t> data;
+        for (std::size_t i = 0; i < n; ++i) {
+            data.insert(data.end(), text.begin(), text.end());
+            data.push_back(static_cast<std::uint8_t>('0' + i % 10));
+        }
+        return data;
+    }
+
+    // The empty input, the dynamic Huffman block with overlapping copies (level 1),
+    // the fixed Huffman block with lazy matching (level 4), and the stored block
+    // of the bytes without matches. The inputs are small to keep the compile time low.
+    static_assert(RoundTrips({}, 6) and RoundTrips(RepeatedText("abcabcab", 8), 1));
+    static_assert(RoundTrips(RepeatedText("<path d='M0 0 L10 10 Z' fill='#A0B0C0'/>", 3), 4));
+    static_assert([] {
+        std::vector<std::uint8_t> data(96);
+        for (std::size_t i = 0; i < data.size(); ++i) data[i] = static_cast<std::uint8_t>(i * 167);
+        return RoundTrips(data, 6);
+    }());
+
+    // Png row filters (bpp is 4). Prev is the previous raw row (zeros for the first row).
+
+    inline void FilterSub(const std::uint8_t *row, const std::size_t size, std::uint8_t *out) {
+        std::memcpy(out, row, std::min<std::size_t>(size, 4));
+        std::size_t i = 4;
+#ifdef __wasm_simd128__
+        for (; i + 16 <= size; i += 16) {
+            const v128_t cur = wasm_v128_load(row + i);
+            const v128_t left = wasm_v128_load(row + i - 4);
+            wasm_v128_store(out + i, wasm_i8x16_sub(cur, left));
+        }
+#endif
+        for (; i < size; ++i) out[i] = row[i] - row[i - 4];
+    }
+
+    inline void FilterUp(const std::uint8_t *row, const std::uint8_t *prev,
+                         const std::size_t size, std::uint8_t *out) {
+        std::size_t i = 0;
+#ifdef __wasm_simd128__
+        for (; i + 16 <= size; i += 16) {
+            const v128_t cur = wasm_v128_load(row + i);
+            const v128_t up = wasm_v128_load(prev + i);
+            wasm_v128_store(out + i, wasm_i8x16_sub(cur, up));
+        }
+#endif
+        for (; i < size; ++i) out[i] = row[i] - prev[i];
+    }
+
+    constexpr void FilterAverage(const std::uint8_t *row, const std::uint8_t *prev,
+                                 const std::size_t size, std::uint8_t *out) {
+        for (std::size_t i = 0; i < size; ++i) {
+            const unsigned left = i >= 4 ? row[i - 4] : 0;
+            out[i] = row[i] - static_cast<std::uint8_t>((left + prev[i]) >> 1);
+        }
+    }
+
+    // Returns the Paeth predictor of the left (a), upper (b), and upper left (c) bytes.
+    constexpr int Paeth(const int a, const int b, const int c) {
+        const auto abs = [](const int val) { return val < 0 ? -val : val; };
+        const int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2 * c);
+        return pa <= pb and pa <= pc ? a : pb <= pc ? b : c;
+    }
+    static_assert(Paeth(1, 2, 3) == 1 and Paeth(10, 20, 5) == 20 and Paeth(10, 0, 5) == 5
+                  and Paeth(7, 7, 7) == 7 and Paeth(0, 0, 0) == 0); // ties prefer a, then b
+
+    constexpr void FilterPaeth(const std::uint8_t *row, const std::uint8_t *prev,
+                               const std::size_t size, std::uint8_t *out) {
+        for (std::size_t i = 0; i < size; ++i) {
+            const int a = i >= 4 ? row[i - 4] : 0, b = prev[i], c = i >= 4 ? prev[i - 4] : 0;
+            out[i] = row[i] - static_cast<std::uint8_t>(Paeth(a, b, c));
+        }
+    }
+
+    // The second Average byte sees the first raw byte as left; the sum doesn't wrap.
+    static_assert([] {
+        constexpr std::uint8_t row[] = {200, 0, 0, 0, 250, 10, 0, 0};
+        constexpr std::uint8_t prev[] = {100, 0, 0, 0, 254, 20, 0, 0};
+        std::uint8_t out[8] = {};
+        FilterAverage(row, prev, 8, out);
+        return out[0] == 150 and out[4] == static_cast<std::uint8_t>(250 - 227) and out[5] == 0;
+    }());
+
+    // Returns the sum of the filtered bytes as signed values (the heuristic to select
+    // the filter: the smaller sum usually compresses better).
+    inline std::uint32_t SumAbs(const std::uint8_t *data, const std::size_t size) {
+        std::uint32_t sum = 0;
+        std::size_t i = 0;
+#ifdef __wasm_simd128__
+        v128_t acc = wasm_i32x4_splat(0);
+        for (; i + 16 <= size; i += 16) {
+            const v128_t abs = wasm_i8x16_abs(wasm_v128_load(data + i));
+            const v128_t sum16 = wasm_u16x8_extadd_pairwise_u8x16(abs);
+            acc = wasm_i32x4_add(acc, wasm_u32x4_extadd_pairwise_u16x8(sum16));
+        }
+        // Abs(-128) wraps to 0x80, which is still 128 as unsigned. Lanes are constants.
+        sum = static_cast<std::uint32_t>(wasm_i32x4_extract_lane(acc, 0))
+              + static_cast<std::uint32_t>(wasm_i32x4_extract_lane(acc, 1))
+              + static_cast<std::uint32_t>(wasm_i32x4_extract_lane(acc, 2))
+              + static_cast<std::uint32_t>(wasm_i32x4_extract_lane(acc, 3));
+#endif
+        for (; i < size; ++i) sum += std::abs(static_cast<int>(static_cast<std::int8_t>(data[i])));
+        return sum;
+    }
+
+    // Returns the FLG byte of the zlib header (RFC 1950, 2.2) after CMF 0x78:
+    // FLEVEL of the level and the check bits.
+    constexpr std::uint8_t ZlibFlags(const int level) {
+        return level <= 1 ? 0x01 : level <= 5 ? 0x5E : level <= 6 ? 0x9C : 0xDA;
+    }
+    static_assert([] {
+        for (int level = 1; level <= 9; ++level) {
+            if ((0x78 << 8 | ZlibFlags(level)) % 31 != 0) return false;
+        }
+        return ZlibFlags(1) >> 6 == 0 and ZlibFlags(5) >> 6 == 1 and ZlibFlags(6) >> 6 == 2
+               and ZlibFlags(9) >> 6 == 3;
+    }());
+
+    // Encodes RGBA pixels (stride is width * 4) to png with the level 1..9
+    // (see raster::SetEncoder()). The png replaces the content of out.
+    inline void CompressPng(const std::uint8_t *rgba, const int width, const int height,
+                            const int level, std::vector<std::uint8_t> &out) {
+        const std::size_t row = static_cast<std::size_t>(width) * 4;
+        // Filtered rows, each prefixed with the filter type.
+        std::vector<std::uint8_t> raw(static_cast<std::size_t>(height) * (row + 1));
+        const std::vector<std::uint8_t> zeros(row);
+        std::vector<std::uint8_t> candidates(level >= 4 ? row * 4 : 0);
+        for (int y = 0; y < height; ++y) {
+            const std::uint8_t *cur = rgba + y * row;
+            const std::uint8_t *prev = y > 0 ? cur - row : zeros.data();
+            std::uint8_t *dst = raw.data() + y * (row + 1);
+            if (level < 4) { // Sub, the fastest filter that helps with gradients and flat areas
+                dst[0] = 1;
+                FilterSub(cur, row, dst + 1);
+                continue;
+            }
+            // Adaptive: the filter with the minimal sum, None is the initial candidate
+            dst[0] = 0;
+            std::memcpy(dst + 1, cur, row);
+            FilterSub(cur, row, candidates.data());
+            FilterUp(cur, prev, row, candidates.data() + row);
+            FilterAverage(cur, prev, row, candidates.data() + 2 * row);
+            FilterPaeth(cur, prev, row, candidates.data() + 3 * row);
+            std::uint32_t best = SumAbs(dst + 1, row);
+            for (std::uint8_t f = 0; f < 4; ++f) {
+                const std::uint32_t sum = SumAbs(candidates.data() + f * row, row);
+                if (sum < best) {
+                    best = sum;
+                    dst[0] = f + 1;
+                    std::memcpy(dst + 1, candidates.data() + f * row, row);
+                }
+            }
+        }
+        out.clear();
+        out.reserve(raw.size() / 2 + 64);
+        const auto be32 = [&out](const std::uint32_t val) {
+            const std::uint8_t bytes[] = {
+                static_cast<std::uint8_t>(val >> 24), static_cast<std::uint8_t>(val >> 16),
+                static_cast<std::uint8_t>(val >> 8), static_cast<std::uint8_t>(val)
+            };
+            out.insert(out.end(), std::begin(bytes), std::end(bytes));
+        };
+        // Chunks are written with the zero size, which is patched by end_chunk.
+        const auto begin_chunk = [&out, &be32](const char *type) {
+            be32(0);
+            out.insert(out.end(), type, type + 4);
+            return out.size() - 4;
+        };
+        const auto end_chunk = [&out, &be32](const std::size_t type) {
+            const std::size_t size = out.size() - type - 4;
+            for (int k = 0; k < 4; ++k) {
+                out[type - 4 + k] = static_cast<std::uint8_t>(size >> (24 - 8 * k));
+            }
+            be32(Crc32(out.data() + type, out.size() - type));
+        };
+        const char signature[] = "\x89PNG\r\n\x1A\n";
+        out.insert(out.end(), signature, signature + 8);
+        // IHDR: 8-bit RGBA, deflate, adaptive filtering, no interlace
+        std::size_t type = begin_chunk("IHDR");
+        be32(width);
+        be32(height);
+        const std::uint8_t ihdr[] = {8, 6, 0, 0, 0};
+        out.insert(out.end(), std::begin(ihdr), std::end(ihdr));
+        end_chunk(type);
+        // IDAT: zlib stream of the filtered rows
+        type = begin_chunk("IDAT");
+        out.push_back(0x78); // deflate, 32K window
+        out.push_back(ZlibFlags(level));
+        Deflate(raw.data(), raw.size(), level, out);
+        std::uint32_t a = 1, b = 0;
+        Adler32(a, b, raw.data(), raw.size());
+        be32(b << 16 | a);
+        end_chunk(type);
+        // IEND
+        type = begin_chunk("IEND");
+        end_chunk(type);
+    }
+
+    // Encodes RGBA pixels to png at the level (see raster::SetEncoder()) and calls
+    // the callback of the encoded output (Encoded, Batch, Buffer, Slot, or Async).
+    // On_encoded is called with the encoding time (-1.0 on failure) and the png size
+    // before the callback, e.g., to record stats. Level 0 is encoded in place
+    // (see aux::EncodePng()), other levels - via the intermediate buffer.
+    template<class OnEncoded>
+    inline void DeliverPng(const std::uint8_t *rgba, const int width, const int height,
+                           Error err, const void *pcb, void *meta, const Output output,
+                           const int level, OnEncoded &&on_encoded) {
+        void *mpcb = const_cast<void *>(pcb);
+        const double export_start = emscripten_get_now();
+        std::vector<std::uint8_t> compressed;
+        std::size_t png_size = 0;
+        if (err == Error::None) {
+            if (level > 0) CompressPng(rgba, width, height, level, compressed);
+            png_size = level > 0 ? compressed.size() : PngSize(width, height);
+        }
+        char *png = nullptr;
+        char *heap = nullptr; // Freed after the callback (unless the callback owns it).
+        if (err == Error::None) {
+            if (output == Output::Buffer) {
+                auto *preq = static_cast<BufferRequest *>(mpcb);
+                png = static_cast<char *>(AllocBuffer(preq, png_size));
+            } else if (level == 0 or output == Output::Async) {
+                png = heap = static_cast<char *>(std::malloc(png_size));
+            } else {
+                png = reinterpret_cast<char *>(compressed.data());
+            }
+            if (png == nullptr) err = Error::BlobExportFailed;
+            else if (level == 0) EncodePng(rgba, width, height, png);
+            else if (png != reinterpret_cast<char *>(compressed.data())) {
+                std::memcpy(png, compressed.data(), png_size);
+            }
+        }
+        on_encoded(png ? emscripten_get_now() - export_start : -1.0, png ? png_size : 0);
+        if (png == nullptr) png_size = 0;
+        switch (output) {
+            case Output::Buffer: // the buffer is owned by the client
+                ExecBufferCb(static_cast<BufferRequest *>(mpcb), png, png_size, err, meta);
+                return;
+            case Output::Async: // the buffer is owned by the awaitable
+                ExecAsyncCb(static_cast<AsyncState *>(mpcb), png, png_size, err, meta);
+                return;
+            case Output::Batch:
+                ExecBatchCb(static_cast<Batch *>(mpcb), png, png_size, err, meta);
+                break;
+            case Output::Slot:
+                ExecSlotCb(static_cast<std::uint32_t>(reinterpret_cast<std::uintptr_t>(pcb)),
+                           png, png_size, err, meta);
+                break;
+            default:
+                ExecCb(static_cast<const Callback *>(pcb), png, png_size, err, meta);
+                break;
+        }
+        std::free(heap);
+    }
+
+    // Executes the callback of raster::Encoder::Wasm with the raw pixels.
+    // The pixels are encoded to png and passed to the callback of the wrapped output.
+    // Pcb, wrapped, and level are the unpacked aux::EncodeOutput() of the request.
+    // The stage timings of JS (elapsed is the total so far, -1.0 if the request
+    // isn't measured) are recorded with the encoding added to the export stage.
+    // This function suits the call from JS (as aux::ExecPixelCb()).
+    extern "C"
+    inline void EMSCRIPTEN_KEEPALIVE ExecEncodeCb(const void *pcb, const int wrapped,
+                                                  const int level,
+                                                  const char *data, std::size_t size,
+                                                  const int width, const int height,
+                                                  Error err, void *meta,
+                                                  const double encode, const double load,
+                                                  const double draw, const double export_js,
+                                                  const double read, const double copy,
+                                                  const double elapsed,
+                                                  const std::size_t input_bytes) {
+        const double start = emscripten_get_now();
+        if (err == Error::None and (data == nullptr or width <= 0 or height <= 0
+                                    or size < static_cast<std::size_t>(width) * height * 4)) {
+            err = Error::BlobExportFailed;
+        }
+        const auto record = [&](const double export_, const std::size_t out_bytes) {
+            if (elapsed < 0.0) return;
+            const Error sample_err = err == Error::None and export_ < 0.0
+                                     ? Error::BlobExportFailed : err;
+            const double export_total = export_ < 0.0 ? -1.0
+                                        : export_ + (export_js < 0.0 ? 0.0 : export_js);
+            RecordSample(encode, load, draw, export_total, read, copy,
+                         elapsed + (emscripten_get_now() - start), input_bytes, out_bytes,
+                         sample_err);
+        };
+        DeliverPng(reinterpret_cast<const std::uint8_t *>(data), width, height, err,
+                   pcb, meta, static_cast<Output>(wrapped), level, record);
+    }
+
+    // Converts svg with the native backend and calls the callback of the output
+    // (the same Exec*Cb() as JS does). The arguments are the same as for aux::SvgToImage(),
+    // level is the same as for aux::EncoderLevel().
+    inline void NativeSvgToImage(const char *data, const std::size_t size, const void *pcb,
+                                 void *meta, const float x, const float y,
+                                 const float width, const float height, const float zoom,
+                                 const Output output, const EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx,
+                                 const int level) {
+        const double start = emscripten_get_now();
+        std::vector<std::uint8_t> pixels;
+        int w = 0, h = 0;
+        Error err = rasterizer
+                    ? rasterizer->Rasterize({data, size}, x, y, width, height, zoom, pixels, w, h)
+                    : Error::NoRasterizer;
+        if (err == Error::None and (w <= 0 or h <= 0
+                                    or pixels.size() < static_cast<std::size_t>(w) * h * 4)) {
+            err = Error::CanvasDrawingFailed;
+        }
+        const double draw = emscripten_get_now() - start;
+        const auto record = [&](const double export_, const std::size_t out_bytes) {
+            if (not stats_enabled) return;
+            RecordSample(-1.0, -1.0, draw, export_, -1.0, -1.0, emscripten_get_now() - start,
+                         size, out_bytes, err);
+        };
+        if (output == Output::Pixels) {
+            record(-1.0, err == Error::None ? pixels.size() : 0);
+            const char *px = err == Error::None ? reinterpret_cast<const char *>(pixels.data())
+                                                : nullptr;
+            ExecPixelCb(static_cast<const PixelCallback *>(pcb), px, px ? pixels.size() : 0,
+                        w, h, err, meta);
+            return;
+        }
+        if (output == Output::Texture) {
+            const double upload_start = emscripten_get_now();
+            unsigned int id = 0;
+            if (err == Error::None) {
+                id = UploadTexture(ctx, pixels.data(), w, h);
+                if (id == 0) err = Error::TextureUploadFailed;
+            }
+            record(err == Error::None ? emscripten_get_now() - upload_start : -1.0, 0);
+            ExecTextureCb(static_cast<const TextureCallback *>(pcb), id, w, h, err, meta);
+            return;
+        }
+        DeliverPng(pixels.data(), w, h, err, pcb, meta, output,
+                   encoder == Encoder::Wasm ? EncoderLevel(level) : native_png_level, record);
+    }
+
+    // Svg preprocessing (see raster::SetMinify() and raster::Input::Uri).
+
+    // Namespaces of the editor data, which is removed by raster::MinifySvg().
+    inline constexpr std::string_view editor_namespaces[] = {
+        "http://www.inkscape.org/namespaces/inkscape",
+        "http://sodipodi.sourceforge.net/DTD/sodipodi-0.dtd",
+        "http://ns.adobe.com/AdobeIllustrator/10.0/",
+        "http://ns.adobe.com/AdobeSVGViewerExtensions/3.0/",
+        "http://ns.adobe.com/Extensibility/1.0/",
+        "http://ns.adobe.com/Flows/1.0/",
+        "http://ns.adobe.com/Graphs/1.0/",
+        "http://ns.adobe.com/ImageReplacement/1.0/",
+        "http://ns.adobe.com/SaveForWeb/1.0/",
+        "http://ns.adobe.com/Variables/1.0/",
+        "http://www.bohemiancoding.com/sketch/ns",
+        "http://www.serif.com/",
+    };
+
+    constexpr bool IsSpace(const char c) {
+        return c == ' ' or c == '\t' or c == '\n' or c == '\r';
+    }
+
+    // Appends text to out with the whitespace runs collapsed to single spaces.
+    constexpr void AppendCollapsed(std::string &out, const std::string_view text) {
+        bool space = false;
+        for (const char c: text) {
+            if (IsSpace(c)) {
+                space = true;
+                continue;
+            }
+            if (space) out += ' ';
+            space = false;
+            out += c;
+        }
+        if (space) out += ' ';
+    }
+
+    // Minifies svg into out (see raster::MinifySvg()) and returns the view of out.
+    // The single pass keeps the state of the current tag only: the editor prefixes are bound
+    // by the xmlns declarations, which precede their use (usually on the root element).
+    constexpr std::string_view MinifySvg(const std::string_view svg, std::string &out) {
+        constexpr std::size_t npos = std::string_view::npos;
+        out.clear();
+        out.reserve(svg.size());
+        std::vector<std::string_view> editor_prefixes;
+        std::vector<std::pair<std::string_view, std::string_view>> attrs; // (name, quoted value)
+        std::size_t skip = 0; // depth inside the removed element
+        std::size_t verbatim = 0; // depth inside the element with significant whitespace
+        const auto is_editor_name = [&editor_prefixes](const std::string_view name) {
+            const std::size_t colon = name.find(':');
+            if (colon == npos) return false;
+            const std::string_view prefix = name.substr(0, colon);
+            if (prefix == "xmlns") {
+                return std::ranges::find(editor_prefixes, name.substr(colon + 1))
+                       != editor_prefixes.end();
+            }
+            return std::ranges::find(editor_prefixes, prefix) != editor_prefixes.end();
+        };
+        const std::size_t n = svg.size();
+        std::size_t i = 0;
+        // Copies the markup up to and including the terminator unless it is skipped.
+        const auto copy_until = [&](const std::string_view end) {
+            std::size_t stop = svg.find(end, i);
+            stop = stop == npos ? n : stop + end.size();
+            if (skip == 0) out.append(svg.substr(i, stop - i));
+            i = stop;
+        };
+        while (i < n) {
+            if (svg[i] != '<') { // text
+                std::size_t end = svg.find('<', i);
+                if (end == npos) end = n;
+                const std::string_view text = svg.substr(i, end - i);
+                i = end;
+                if (skip > 0) continue;
+                if (verbatim > 0) out.append(text);
+                else if (text.find_first_not_of(" \t\n\r") != npos) AppendCollapsed(out, text);
+                continue;
+            }
+            const std::string_view rest = svg.substr(i);
+            if (rest.starts_with("<!--")) {
+                const std::size_t end = svg.find("-->", i + 4);
+                i = end == npos ? n : end + 3;
+                continue;
+            }
+            if (rest.starts_with("<![CDATA[")) {
+                copy_until("]]>");
+                continue;
+            }
+            if (rest.starts_with("<?")) {
+                copy_until("?>");
+                continue;
+            }
+            if (rest.starts_with("<!")) { // doctype, possibly with the internal subset
+                const std::size_t bracket = svg.find_first_of("[>", i);
+                copy_until(bracket != npos and svg[bracket] == '[' ? "]>" : ">");
+                continue;
+            }
+            if (rest.starts_with("</")) {
+                std::size_t j = i + 2;
+                while (j < n and not IsSpace(svg[j]) and svg[j] != '>') ++j;
+                const std::string_view name = svg.substr(i + 2, j - i - 2);
+                const std::size_t end = svg.find('>', j);
+                i = end == npos ? n : end + 1;
+                if (skip > 0) {
+                    --skip;
+                    continue;
+                }
+                if (verbatim > 0) --verbatim;
+                out += "</";
+                out += name;
+                out += '>';
+                continue;
+            }
+            // start tag
+            std::size_t j = i + 1;
+            while (j < n and not IsSpace(svg[j]) and svg[j] != '/' and svg[j] != '>') ++j;
+            const std::string_view name = svg.substr(i + 1, j - i - 1);
+            attrs.clear();
+            bool self_closing = false;
+            while (j < n) {
+                if (IsSpace(svg[j])) {
+                    ++j;
+                    continue;
+                }
+                if (svg[j] == '>') {
+                    ++j;
+                    break;
+                }
+                if (svg[j] == '/') {
+                    self_closing = true;
+                    ++j;
+                    continue;
+                }
+                const std::size_t attr_start = j;
+                while (j < n and not IsSpace(svg[j]) and svg[j] != '=' and svg[j] != '>'
+                       and svg[j] != '/') ++j;
+                const std::string_view attr = svg.substr(attr_start, j - attr_start);
+                while (j < n and IsSpace(svg[j])) ++j;
+                std::string_view value;
+                if (j < n and svg[j] == '=') {
+                    ++j;
+                    while (j < n and IsSpace(svg[j])) ++j;
+                    const std::size_t value_start = j;
+                    if (j < n and (svg[j] == '"' or svg[j] == '\'')) {
+                        const std::size_t close = svg.find(svg[j], j + 1);
+                        j = close == npos ? n : close + 1;
+                    } else {
+                        while (j < n and not IsSpace(svg[j]) and svg[j] != '>') ++j;
+                    }
+                    value = svg.substr(value_start, j - value_start);
+                }
+                if (not attr.empty()) attrs.emplace_back(attr, value);
+            }
+            i = j;
+            if (skip > 0) {
+                if (not self_closing) ++skip;
+                continue;
+            }
+            for (const auto &[attr, value]: attrs) {
+                if (not attr.starts_with("xmlns:") or value.size() < 2) continue;
+                const std::string_view uri = value.substr(1, value.size() - 2);
+                if (std::ranges::find(editor_namespaces, uri) != std::end(editor_namespaces)) {
+                    editor_prefixes.push_back(attr.substr(6));
+                }
+            }
+            if (name == "metadata" or is_editor_name(name)) {
+                if (not self_closing) skip = 1;
+                continue;
+            }
+            if (verbatim > 0) {
+                if (not self_closing) ++verbatim;
+            } else if (not self_closing and (name == "text" or name == "style" or name == "script"
+                                             or name == "foreignObject")) {
+                verbatim = 1;
+            }
+            out += '<';
+            out += name;
+            for (const auto &[attr, value]: attrs) {
+                if (is_editor_name(attr)) continue;
+                out += ' ';
+                out += attr;
+                if (value.empty()) continue;
+                out += '=';
+                AppendCollapsed(out, value);
+            }
+            out += self_closing ? "/>" : ">";
+        }
+        return out;
+    }
+
+    // Returns true if aux::MinifySvg() of svg is expected.
+    constexpr bool Minifies(const std::string_view svg, const std::string_view expected) {
+        std::string out;
+        return MinifySvg(svg, out) == expected;
+    }
+
+    // The whitespace between the tags and inside the text and the values, the nested skipped
+    // elements and comments, and the nested verbatim elements (the depth is tracked,
+    // so the whitespace after </text> is collapsed again).
+    static_assert(Minifies("<svg>\n  <g  fill=\"a  b\" >  x \n y  </g>\n</svg>",
+                           "<svg><g fill=\"a b\"> x y </g></svg>"));
+    static_assert(Minifies("<svg><metadata><rdf><x/>t</rdf></metadata><!-- c --><g/></svg>",
+                           "<svg><g/></svg>"));
+    static_assert(Minifies("<svg><text> a <tspan>  b  </tspan> </text>  <g> c  d </g></svg>",
+                           "<svg><text> a <tspan>  b  </tspan> </text><g> c d </g></svg>"));
+    // '>' inside the quoted values, the CDATA copied as is.
+    static_assert(Minifies("<path d='a>b' title=\"x > y\"/><style><![CDATA[a > b {}]]></style>",
+                           "<path d='a>b' title=\"x > y\"/><style><![CDATA[a > b {}]]></style>"));
+    // The editor elements and attributes of the declared prefixes only.
+    static_assert(Minifies("<svg xmlns:inkscape=\"http://www.inkscape.org/namespaces/inkscape\" "
+                           "inkscape:version=\"1\" id=\"s\"><inkscape:grid><g/></inkscape:grid>"
+                           "<g inkscape:label=\"L\"/><sodipodi:namedview/></svg>",
+                           "<svg id=\"s\"><g/><sodipodi:namedview/></svg>"));
+
+    // Prefix of the data uri encoded by aux::EncodeDataUri().
+    inline constexpr std::string_view data_uri_prefix = "data:image/svg+xml;charset=utf8,";
+
+    // Nibble tables of the bytes escaped by aux::EncodeDataUri(): a byte is escaped if
+    // escape_lo[byte & 0xF] & escape_hi[byte >> 4] is nonzero. Each bit is a row of the ASCII
+    // table: controls and non-ASCII (bit 0), ' "#%' (1), '<>' (2), '[\]^' (3), '`' (4),
+    // and '{|}' with DEL (5). Everything else is valid in the data uri as is.
+    alignas(16) inline constexpr std::uint8_t escape_lo[16] = {
+        0x13, 0x01, 0x03, 0x03, 0x01, 0x03, 0x01, 0x01,
+        0x01, 0x01, 0x01, 0x29, 0x2D, 0x29, 0x0D, 0x21
+    };
+    alignas(16) inline constexpr std::uint8_t escape_hi[16] = {
+        0x01, 0x01, 0x02, 0x04, 0x00, 0x08, 0x10, 0x20,
+        0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01
+    };
+
+    constexpr bool NeedsEscape(const std::uint8_t c) {
+        return (escape_lo[c & 0xF] & escape_hi[c >> 4]) != 0;
+    }
+
+    // Every byte of the tables against the escaped set: controls, space, non-ASCII,
+    // and the printable bytes that are invalid in the uri.
+    static_assert([] {
+        constexpr std::string_view invalid = "\"#%<>[\\]^`{|}";
+        for (int c = 0; c < 256; ++c) {
+            const bool escaped = c <= 0x20 or c >= 0x7F
+                                 or invalid.find(static_cast<char>(c)) != std::string_view::npos;
+            if (NeedsEscape(static_cast<std::uint8_t>(c)) != escaped) return false;
+        }
+        return true;
+    }());
+
+    // Percent-encodes svg as data uri into out and returns the view of out.
+    // Only the bytes that are invalid in the uri are escaped (unlike encodeURIComponent()),
+    // so the uri is smaller. With WASM SIMD, 16-byte runs without such bytes are copied as is.
+    // The scalar path is constexpr (SIMD is skipped in the constant evaluation).
+    constexpr std::string_view EncodeDataUri(const std::string_view svg, std::string &out) {
+        constexpr char hex[] = "0123456789ABCDEF";
+        const std::size_t size = svg.size();
+        out.clear();
+        out.reserve(data_uri_prefix.size() + size + size / 4);
+        out.append(data_uri_prefix);
+        std::size_t i = 0;
+        while (i < size) {
+#ifdef __wasm_simd128__
+            if (not std::is_constant_evaluated() and i + 16 <= size) {
+                const v128_t c = wasm_v128_load(svg.data() + i);
+                const v128_t nibble = wasm_i8x16_splat(0x0F);
+                const v128_t lo = wasm_i8x16_swizzle(wasm_v128_load(escape_lo),
+                                                     wasm_v128_and(c, nibble));
+                const v128_t hi = wasm_i8x16_swizzle(wasm_v128_load(escape_hi),
+                                                     wasm_u8x16_shr(c, 4));
+                if (not wasm_v128_any_true(wasm_v128_and(lo, hi))) {
+                    out.append(svg.data() + i, 16);
+                    i += 16;
+                    continue;
+                }
+            }
+#endif
+            for (const std::size_t end = std::min<std::size_t>(size, i + 16); i < end; ++i) {
+                const auto c = static_cast<std::uint8_t>(svg[i]);
+                if (not NeedsEscape(c)) {
+                    out += svg[i];
+                    continue;
+                }
+                const char escaped[] = {'%', hex[c >> 4], hex[c & 0xF]};
+                out.append(escaped, 3);
+            }
+        }
+        return out;
+    }
+
+    // Returns true if aux::EncodeDataUri() of svg is the prefix followed by expected.
+    constexpr bool EncodesUri(const std::string_view svg, const std::string_view expected) {
+        std::string out;
+        const std::string_view uri = EncodeDataUri(svg, out);
+        return uri.starts_with(data_uri_prefix) and uri.substr(data_uri_prefix.size()) == expected;
+    }
+
+    // The runs longer than 16 bytes, the escapes at both ends, and the non-ASCII bytes.
+    static_assert(EncodesUri("", "") and EncodesUri("%", "%25"));
+    static_assert(EncodesUri("<svg xmlns='http://www.w3.org/2000/svg'><path fill=\"#0A0\"/>\n",
+                             "%3Csvg%20xmlns='http://www.w3.org/2000/svg'%3E%3Cpath%20fill="
+                             "%22%230A0%22/%3E%0A"));
+    static_assert(EncodesUri("<text>caf\xC3\xA9 {a|b} [c]^`\x7F</text>",
+                             "%3Ctext%3Ecaf%C3%A9%20%7Ba%7Cb%7D%20%5Bc%5D%5E%60%7F%3C/text%3E"));
+
+    // Returns svg prepared for JS: minified (see raster::SetMinify()) and percent-encoded
+    // for raster::Input::Uri. Buf holds the result unless svg is passed as is.
+    // JS reads the svg synchronously, so buf may be released after the conversion call.
+    inline std::string_view PrepareSvg(const std::string_view svg, const int input,
+                                       std::string &buf) {
+        if (input == static_cast<int>(Input::Uri)) {
+            std::string minified;
+            return EncodeDataUri(minify ? MinifySvg(svg, minified) : svg, buf);
+        }
+        return minify ? MinifySvg(svg, buf) : svg;
+    }
+
+    // Wraps the png output for raster::Encoder::Wasm (see aux::EncodeOutput()):
+    // JS reads back the pixels, and the callback is called with the png encoded in C++.
+    // Level is the same as for aux::EncoderLevel().
+    // Returns the output to pass to JS (the same output if it isn't wrapped).
+    inline int WrapEncoder(const char *format, const int output, const int level) {
+        const auto out = static_cast<Output>(output);
+        const bool encoded = out == Output::Encoded or out == Output::Batch
+                             or out == Output::Buffer or out == Output::Slot
+                             or out == Output::Async;
+        if (encoder != Encoder::Wasm or not encoded or std::strcmp(format, "image/png") != 0) {
+            return output;
+        }
+        return EncodeOutput(out, EncoderLevel(level));
+    }
+
+    // Starts the conversion with the backend (see raster::Backend).
+    // The arguments are the same as for aux::SvgToImage(), level is the same as for
+    // aux::EncoderLevel(). The native backend completes the conversion synchronously,
+    // so there is no request id (returns 0).
+    inline int Convert(const char *data, std::size_t size, const void *pcb,
+                       void *meta, const char *format, const float quality,
+                       const float x, const float y, const float width, const float height,
+                       const float zoom, const int backend, const int input, const int output,
+                       const EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx, const int level = -1) {
+        std::string buf; // the preprocessed svg is alive until JS reads it
+        if (backend == static_cast<int>(Backend::Native)) {
+            const std::string_view svg = PrepareSvg({data, size},
+                                                    static_cast<int>(Input::DataUri), buf);
+            NativeSvgToImage(svg.data(), svg.size(), pcb, meta, x, y, width, height, zoom,
+                             static_cast<Output>(output), ctx, level);
+            return 0;
+        }
+        const std::string_view svg = PrepareSvg({data, size}, input, buf);
+        data = svg.data();
+        size = svg.size();
+        const int out = WrapEncoder(format, output, level);
+        return SvgToImage(data, size, pcb, meta, format, quality, x, y, width, height, zoom,
+                          backend, input, out, ctx);
+    }
+
+    // Starts the conversion of raster::SvgToImage() with raster::Callback.
+    // Level is the same as for aux::EncoderLevel().
+    inline Request ConvertEncoded(std::string_view svg, Callback cb, void *meta,
+                                  const std::string &format, float quality, float x, float y,
+                                  float width, float height, float zoom, int level);
+
+    // Returns the leading number of the svg length attribute (units are ignored).
+    inline float ParseLength(const std::string_view value, std::size_t &pos) noexcept {
+        while (pos < value.size() and (IsSpace(value[pos]) or value[pos] == ',')) ++pos;
+        float number = 0.0f;
+        float scale = 0.0f; // 0 - the integer part
+        for (; pos < value.size(); ++pos) {
+            const char c = value[pos];
+            if (c == '.' and scale == 0.0f) {
+                scale = 0.1f;
+            } else if (c >= '0' and c <= '9') {
+                if (scale == 0.0f) {
+                    number = number * 10.0f + static_cast<float>(c - '0');
+                } else {
+                    number += scale * static_cast<float>(c - '0');
+                    scale *= 0.1f;
+                }
+            } else {
+                break;
+            }
+        }
+        return number;
+    }
+
+    // Returns the value of the attribute of the tag (empty if there is none).
+    inline std::string_view FindAttribute(const std::string_view tag,
+                                          const std::string_view name) noexcept {
+        for (std::size_t pos = tag.find(name); pos != std::string_view::npos;
+             pos = tag.find(name, pos + 1)) {
+            if (pos == 0 or not IsSpace(tag[pos - 1])) continue; // e.g., stroke-width
+            std::size_t eq = pos + name.size();
+            while (eq < tag.size() and IsSpace(tag[eq])) ++eq;
+            if (eq + 1 >= tag.size() or tag[eq] != '=') continue;
+            ++eq;
+            while (eq < tag.size() and IsSpace(tag[eq])) ++eq;
+            const char quote = tag[eq];
+            if (quote != '"' and quote != '\'') continue;
+            const std::size_t end = tag.find(quote, eq + 1);
+            if (end == std::string_view::npos) return {};
+            return tag.substr(eq + 1, end - eq - 1);
+        }
+        return {};
+    }
+
+    // Returns the intrinsic size of svg as the browser would size <img>:
+    // the root width and height, the viewBox size, or 300x150.
+    inline std::pair<float, float> SvgSize(const std::string_view svg) noexcept {
+        std::pair<float, float> size{300.0f, 150.0f};
+        const std::size_t start = svg.find("<svg");
+        if (start == std::string_view::npos) return size;
+        const std::size_t end = svg.find('>', start);
+        const std::string_view tag = svg.substr(start, end - start);
+        const std::string_view box = FindAttribute(tag, "viewBox");
+        if (not box.empty()) {
+            std::size_t pos = 0;
+            ParseLength(box, pos); // min-x
+            ParseLength(box, pos); // min-y
+            const float width = ParseLength(box, pos);
+            const float height = ParseLength(box, pos);
+            if (width > 0.0f and height > 0.0f) size = {width, height};
+        }
+        std::size_t pos = 0;
+        const std::string_view width = FindAttribute(tag, "width");
+        if (const float w = ParseLength(width, pos); w > 0.0f) size.first = w;
+        pos = 0;
+        const std::string_view height = FindAttribute(tag, "height");
+        if (const float h = ParseLength(height, pos); h > 0.0f) size.second = h;
+        return size;
+    }
+
+    // Conversion queued by raster::Scheduler.
+    struct ScheduledJob {
+        int priority;
+        std::uint64_t seq; // Submission order for FIFO within the priority.
+        std::size_t cost; // Estimated memory (in bytes).
+        std::string svg; // Owned copy of the svg data.
+        Callback cb;
+        void *meta;
+        std::string format;
+        float quality;
+        float x;
+        float y;
+        float width;
+        float height;
+        float zoom;
+        int level; // Png level at the submission (see aux::EncoderLevel()).
+    };
+
+    // State of raster::Scheduler.
+    struct SchedulerState : std::enable_shared_from_this<SchedulerState> {
+        std::vector<ScheduledJob> queue; // Heap by (priority, -seq).
+        std::uint64_t seq = 0;
+        std::size_t budget = 0;
+        SchedulerStats stats;
+        bool dispatching = false; // Guards Dispatch() from the reentrant calls.
+
+        // Returns true if the job lhs goes after rhs.
+        static bool After(const ScheduledJob &lhs, const ScheduledJob &rhs) noexcept {
+            return lhs.priority != rhs.priority ? lhs.priority < rhs.priority
+                                                : lhs.seq > rhs.seq;
+        }
+
+        // Returns true if the conversion of the cost may be started now.
+        bool Admits(const std::size_t cost) const noexcept {
+            return stats.in_flight == 0 or stats.in_flight_bytes + cost <= budget;
         }
 
-        // Processes the <canvas> blob.
-        function processBlob(blob) {
-            if (!blob) {
-                failed(RasterError.BlobExportFailed);
-                return;
+        // Starts the conversion and accounts its cost until the callback.
+        void Start(std::size_t cost, std::string_view svg, Callback cb, void *meta,
+                   const std::string &format, float quality, float x, float y,
+                   float width, float height, float zoom, int level);
+
+        // Starts the queued conversions while the budget allows.
+        void Dispatch() {
+            if (dispatching) return; // the outer call continues dispatching
+            dispatching = true;
+            while (not queue.empty() and Admits(queue.front().cost)) {
+                std::pop_heap(queue.begin(), queue.end(), After);
+                ScheduledJob job = std::move(queue.back());
+                queue.pop_back();
+                --stats.queued;
+                Start(job.cost, job.svg, std::move(job.cb), job.meta, job.format, job.quality,
+                      job.x, job.y, job.width, job.height, job.zoom, job.level);
             }
-            function onRejected(e) { failed(RasterError.BlobExportFailed); }
-            blob.arrayBuffer().then(loadImage, onRejected);
+            dispatching = false;
         }
+    };
 
-        // Loads raster image on the heap and calls the callback.
-        function loadImage(buf) {
-            const arr = new Uint8Array(buf);
-            const on_heap = Module._malloc(arr.length);
-            writeArrayToMemory(arr, on_heap); // emsc
-            try {
-                Module.ccall("ExecCb",
-                             "v", ["number", "number", "number", "number", "number"],
-                             [pcb, on_heap, arr.length, RasterError.None, meta]);
-            } catch(e) {
-                // The callback function seems broken, so just alert.
-                alert("svg2img: Callback error: " + e.toString());
-            } finally {
-                Module._free(on_heap);
+    inline void Dispatch(Batch *batch) {
+        if (batch->dispatching) return; // the outer call continues dispatching
+        batch->dispatching = true;
+        while (batch->in_flight < batch->max_in_flight and batch->next < batch->queue.size()) {
+            const std::size_t idx = batch->queue[batch->next++];
+            const Job &job = batch->jobs[idx];
+            assert(job.width >= 0 and job.height >= 0 and job.zoom > 0
+                   && "Wrong job arguments [raster::SvgToImages()]");
+            ++batch->in_flight;
+            if (job.svg.empty() or job.svg[0] == '\0') {
+                Complete(batch, idx, std::string_view(), Error::NoInputData);
+                continue;
             }
+            // svg not empty
+            Convert(job.svg.data(), job.svg.size(), batch, reinterpret_cast<void *>(idx),
+                    job.format.c_str(), job.quality, job.x, job.y, job.width, job.height,
+                    job.zoom, static_cast<int>(backend), static_cast<int>(input),
+                    static_cast<int>(Output::Batch), 0, job.level);
+        }
+        batch->dispatching = false;
+        if (batch->done == batch->jobs.size()) {
+            if (batch->cb) batch->cb(batch->jobs.size(), batch->failed, batch->meta);
+            delete batch;
         }
+    }
 
-        // -------------------------------------------------------------------
-        // Main
-        // -------------------------------------------------------------------
+    inline void Complete(Batch *batch, const std::size_t idx, const std::string_view img,
+                         const Error err) {
+        const Job &job = batch->jobs[idx];
+        --batch->in_flight;
+        ++batch->done;
+        if (err != Error::None) ++batch->failed;
+        if (job.cb) job.cb(img, err, job.meta);
+        Dispatch(batch);
+    }
 
-        const data_uri = svgToDataUri(data, size);
-        if (data_uri === null) { return; }
-        // 'format' may point to a temporary object. In this case, when the img.onload
-        // event occurs, this object will be destroyed, and we will get the dangling pointer.
-        // To prevent this, we are currently casting it to the JS string.
-        const sformat = UTF8ToString(format);
-        let img = document.createElement("img");
-        img.src = data_uri;
-        // For browser compatibility, we use two possible names of the same event.
-        img.error = (event) => { failed(RasterError.ImgLoadingFailed); };
-        img.onerror = (event) => { failed(RasterError.ImgLoadingFailed); };
-        img.onload = (event) => { drawSvg(img, sformat); };
-    });
+    // Byte readers for raster::GetImageInfo().
+    // Out-of-range reads return 0; the parsers check the size of the whole field range,
+    // so truncated images keep the default fields.
 
-    // Executes the client's callback.
-    // This function suits the call from JS.
-    extern "C"
-    inline void EMSCRIPTEN_KEEPALIVE ExecCb(PCallback pcb,
-                                            const char *data, std::size_t size,
-                                            const Error err, void *meta) {
-        const Callback cb = *pcb;
-        if (data != nullptr and size > 0) cb({data, size}, err, meta);
-        else cb(std::string_view(), err, meta);
-        delete pcb;
+    constexpr std::uint32_t ReadU8(const std::string_view img, const std::size_t pos) noexcept {
+        return pos < img.size() ? static_cast<std::uint8_t>(img[pos]) : 0;
+    }
+
+    constexpr std::uint32_t ReadBe16(const std::string_view img, const std::size_t pos) noexcept {
+        return ReadU8(img, pos) << 8 | ReadU8(img, pos + 1);
+    }
+
+    constexpr std::uint32_t ReadBe32(const std::string_view img, const std::size_t pos) noexcept {
+        return ReadBe16(img, pos) << 16 | ReadBe16(img, pos + 2);
+    }
+
+    constexpr std::uint32_t ReadLe16(const std::string_view img, const std::size_t pos) noexcept {
+        return ReadU8(img, pos) | ReadU8(img, pos + 1) << 8;
+    }
+
+    constexpr std::uint32_t ReadLe24(const std::string_view img, const std::size_t pos) noexcept {
+        return ReadLe16(img, pos) | ReadU8(img, pos + 2) << 16;
+    }
+
+    // Returns true if img contains sig at pos.
+    constexpr bool Matches(const std::string_view img, const std::size_t pos,
+                           const std::string_view sig) noexcept {
+        return pos <= img.size() and img.substr(pos, sig.size()) == sig;
+    }
+
+    // Parses png IHDR (it always follows the signature).
+    constexpr void ParsePng(const std::string_view img, ImageInfo &info) noexcept {
+        if (img.size() < 26 or not Matches(img, 12, "IHDR")) return;
+        info.width = static_cast<int>(ReadBe32(img, 16));
+        info.height = static_cast<int>(ReadBe32(img, 20));
+        info.bit_depth = static_cast<int>(ReadU8(img, 24));
+        const std::uint32_t color_type = ReadU8(img, 25);
+        info.alpha = color_type == 4 or color_type == 6; // gray + alpha, rgb + alpha
+    }
+
+    // Parses the first jpeg SOFn segment (SOF0..SOF15, except DHT, JPG, and DAC).
+    constexpr void ParseJpeg(const std::string_view img, ImageInfo &info) noexcept {
+        std::size_t pos = 2; // after SOI
+        while (pos + 4 <= img.size() and ReadU8(img, pos) == 0xFF) {
+            const std::uint32_t marker = ReadU8(img, pos + 1);
+            if (marker == 0xFF) { // fill byte
+                ++pos;
+                continue;
+            }
+            if (marker == 0xD9 or marker == 0xDA) return; // EOI, SOS
+            if (marker == 0x01 or (marker >= 0xD0 and marker <= 0xD8)) { // no length
+                pos += 2;
+                continue;
+            }
+            if (marker >= 0xC0 and marker <= 0xCF
+                and marker != 0xC4 and marker != 0xC8 and marker != 0xCC) {
+                if (pos + 9 > img.size()) return;
+                info.bit_depth = static_cast<int>(ReadU8(img, pos + 4));
+                info.height = static_cast<int>(ReadBe16(img, pos + 5));
+                info.width = static_cast<int>(ReadBe16(img, pos + 7));
+                return;
+            }
+            pos += 2 + ReadBe16(img, pos + 2);
+        }
+    }
+
+    // Parses the first webp chunk (the chunk header starts at 12).
+    constexpr void ParseWebp(const std::string_view img, ImageInfo &info) noexcept {
+        if (Matches(img, 12, "VP8 ")) { // lossy: frame tag (3), start code (3), size (2 + 2)
+            if (img.size() < 30 or not Matches(img, 23, "\x9D\x01\x2A")) return;
+            info.width = static_cast<int>(ReadLe16(img, 26) & 0x3FFF);
+            info.height = static_cast<int>(ReadLe16(img, 28) & 0x3FFF);
+            info.bit_depth = 8;
+        } else if (Matches(img, 12, "VP8L")) { // lossless: 14-bit sizes, alpha hint
+            if (img.size() < 25 or ReadU8(img, 20) != 0x2F) return;
+            const std::uint32_t bits = ReadLe16(img, 21) | ReadLe16(img, 23) << 16;
+            info.width = static_cast<int>((bits & 0x3FFF) + 1);
+            info.height = static_cast<int>((bits >> 14 & 0x3FFF) + 1);
+            info.alpha = (bits >> 28 & 1) != 0;
+            info.bit_depth = 8;
+        } else if (Matches(img, 12, "VP8X")) { // extended: flags, 24-bit canvas sizes
+            if (img.size() < 30) return;
+            info.alpha = (ReadU8(img, 20) & 0x10) != 0;
+            info.width = static_cast<int>(ReadLe24(img, 24) + 1);
+            info.height = static_cast<int>(ReadLe24(img, 27) + 1);
+            info.bit_depth = 8;
+        }
     }
 }
 
 namespace raster {
-    inline void SvgToImage(const std::string_view svg, Callback cb, void *meta,
-                           const std::string& format, const float quality,
-                           const float x, const float y,
-                           const float width, const float height, const float zoom) {
+    inline Request aux::ConvertEncoded(const std::string_view svg, Callback cb, void *meta,
+                                       const std::string &format, const float quality,
+                                       const float x, const float y, const float width,
+                                       const float height, const float zoom, const int level) {
         assert(width >= 0 and height >= 0 and zoom > 0
                && "Wrong arguments [raster::SvgToImage()]");
         if (svg.empty() or svg[0] == '\0') {
             cb(std::string_view(), Error::NoInputData, meta);
-            return;
+            return {};
+        }
+        // svg not empty
+        if (aux::coalescing) {
+            aux::CacheKey key = aux::MakeCacheKey(svg, format, quality, x, y, width, height,
+                                                  zoom, level);
+            auto [it, inserted] = aux::in_flight.try_emplace(key);
+            const int waiter = aux::next_waiter_id++;
+            it->second.waiters.push_back({waiter, std::move(cb), meta});
+            if (not inserted) return Request(-waiter); // attached to the pending conversion
+            aux::InitRuntime();
+            aux::PCallback pcb = new Callback([key](const std::string_view img, const Error err,
+                                                    void *) {
+                aux::CompleteInFlight(key, img, err);
+            });
+            const int request = aux::Convert(svg.data(), svg.size(), pcb, nullptr,
+                                             format.c_str(), quality, x, y, width, height, zoom,
+                                             static_cast<int>(aux::backend),
+                                             static_cast<int>(aux::input),
+                                             static_cast<int>(aux::Output::Encoded), 0, level);
+            // The native backend completes synchronously (request is 0, the entry is gone).
+            if (request != 0) aux::in_flight.at(key).request = request;
+            return Request(-waiter);
+        }
+        aux::InitRuntime();
+        aux::PCallback pcb = new Callback(std::move(cb));
+        return Request(aux::Convert(svg.data(), svg.size(), pcb, meta, format.c_str(),
+                                    quality, x, y, width, height, zoom,
+                                    static_cast<int>(aux::backend), static_cast<int>(aux::input),
+                                    static_cast<int>(aux::Output::Encoded), 0, level));
+    }
+
+    inline Request SvgToImage(const std::string_view svg, Callback cb, void *meta,
+                              const std::string& format, const float quality,
+                              const float x, const float y,
+                              const float width, const float height, const float zoom) {
+        return aux::ConvertEncoded(svg, std::move(cb), meta, format, quality,
+                                   x, y, width, height, zoom, -1);
+    }
+
+    inline Request SvgToImage(const std::span<const std::string_view> chunks, Callback cb,
+                              void *meta, const std::string& format, const float quality,
+                              const float x, const float y,
+                              const float width, const float height, const float zoom) {
+        assert(width >= 0 and height >= 0 and zoom > 0
+               && "Wrong arguments [raster::SvgToImage()]");
+        std::vector<aux::SvgDesc> descs;
+        descs.reserve(chunks.size());
+        for (const std::string_view chunk : chunks) {
+            if (not chunk.empty()) descs.push_back({chunk.data(), chunk.size()});
+        }
+        if (descs.empty() or descs.front().data[0] == '\0') {
+            cb(std::string_view(), Error::NoInputData, meta);
+            return {};
         }
         // svg not empty
+        aux::InitRuntime();
         aux::PCallback pcb = new Callback(std::move(cb));
-        aux::SvgToImage(svg.data(), svg.size(), pcb, meta, format.c_str(),
-                        quality, x, y, width, height, zoom);
+        if (aux::backend == Backend::Native) {
+            std::string svg;
+            for (const aux::SvgDesc &d : descs) svg.append(d.data, d.size);
+            return Request(aux::Convert(svg.data(), svg.size(), pcb, meta, format.c_str(),
+                                        quality, x, y, width, height, zoom,
+                                        static_cast<int>(aux::backend),
+                                        static_cast<int>(Input::Blob),
+                                        static_cast<int>(aux::Output::Encoded), 0));
+        }
+        const int output = aux::WrapEncoder(format.c_str(),
+                                            static_cast<int>(aux::Output::Encoded), -1);
+        return Request(aux::SvgChunksToImage(descs.data(), descs.size(), pcb, meta,
+                                             format.c_str(), quality, x, y, width, height,
+                                             zoom, static_cast<int>(aux::backend),
+                                             static_cast<int>(Input::Blob), output, 0));
+    }
+
+    template<Format F>
+        requires (mime_type<F> != nullptr)
+    inline Request SvgToImage(const std::string_view svg, Callback cb, const Options &opts,
+                              void *meta) {
+        assert(opts.width >= 0 and opts.height >= 0 and opts.zoom > 0
+               && "Wrong arguments [raster::SvgToImage()]");
+        if (svg.empty() or svg[0] == '\0') {
+            cb(std::string_view(), Error::NoInputData, meta);
+            return {};
+        }
+        // svg not empty
+        if (aux::coalescing or aux::backend == Backend::Native) {
+            return aux::ConvertEncoded(svg, std::move(cb), meta, mime_type<F>, opts.quality,
+                                       opts.x, opts.y, opts.width, opts.height, opts.zoom,
+                                       opts.level);
+        }
+        aux::InitRuntime();
+        const void *pcb = new Callback(std::move(cb));
+        int output = static_cast<int>(aux::Output::Encoded);
+        if constexpr (F == Format::Png) {
+            output = aux::WrapEncoder(mime_type<F>, output, opts.level);
+        }
+        std::string buf; // the preprocessed svg is alive until JS reads it
+        const std::string_view src = aux::PrepareSvg(svg, static_cast<int>(aux::input), buf);
+        return Request(aux::SvgToImageWith(src.data(), src.size(), pcb, meta,
+                                           static_cast<int>(F), &opts,
+                                           static_cast<int>(aux::backend),
+                                           static_cast<int>(aux::input), output));
+    }
+
+    template<class F>
+        requires std::is_invocable_v<std::decay_t<F> &, std::string_view, Error, void *>
+    inline Request SvgToImage(const std::string_view svg, F &&cb, void *meta,
+                              const std::string& format, const float quality,
+                              const float x, const float y,
+                              const float width, const float height, const float zoom) {
+        using Fn = std::decay_t<F>;
+        assert(width >= 0 and height >= 0 and zoom > 0
+               && "Wrong arguments [raster::SvgToImage()]");
+        if constexpr (aux::fits_slot<Fn>) {
+            if (not aux::coalescing and not svg.empty() and svg[0] != '\0') {
+                const std::uint32_t idx = aux::slots.Acquire();
+                if (idx != aux::SlotPool::npos) {
+                    aux::Slot &slot = aux::slots[idx];
+                    ::new (static_cast<void *>(slot.storage)) Fn(std::forward<F>(cb));
+                    slot.invoke = aux::InvokeSlot<Fn>;
+                    aux::InitRuntime();
+                    const auto pcb = reinterpret_cast<const void *>(static_cast<std::uintptr_t>(idx));
+                    return Request(aux::Convert(svg.data(), svg.size(), pcb, meta,
+                                                format.c_str(), quality,
+                                                x, y, width, height, zoom,
+                                                static_cast<int>(aux::backend),
+                                                static_cast<int>(aux::input),
+                                                static_cast<int>(aux::Output::Slot), 0));
+                }
+            }
+        }
+        // fallback
+        return SvgToImage(svg, Callback(std::forward<F>(cb)), meta, format, quality,
+                          x, y, width, height, zoom);
+    }
+
+    inline Request SvgToImage(const std::string_view svg, BufferCallback cb, void *meta,
+                              const std::string& format, const float quality,
+                              const float x, const float y,
+                              const float width, const float height, const float zoom,
+                              const Allocator alloc) {
+        assert(width >= 0 and height >= 0 and zoom > 0
+               && "Wrong arguments [raster::SvgToImage()]");
+        if (svg.empty() or svg[0] == '\0') {
+            cb(ImageBuffer(), Error::NoInputData, meta);
+            return {};
+        }
+        // svg not empty
+        aux::InitRuntime();
+        aux::PBufferRequest preq = new aux::BufferRequest{std::move(cb), alloc};
+        return Request(aux::Convert(svg.data(), svg.size(), preq, meta, format.c_str(),
+                                    quality, x, y, width, height, zoom,
+                                    static_cast<int>(aux::backend), static_cast<int>(aux::input),
+                                    static_cast<int>(aux::Output::Buffer), 0));
+    }
+
+    inline Request SvgToImage(const std::string_view svg, PixelCallback cb, void *meta,
+                              const float x, const float y,
+                              const float width, const float height, const float zoom) {
+        assert(width >= 0 and height >= 0 and zoom > 0
+               && "Wrong arguments [raster::SvgToImage()]");
+        if (svg.empty() or svg[0] == '\0') {
+            cb(Pixels(), Error::NoInputData, meta);
+            return {};
+        }
+        // svg not empty
+        aux::InitRuntime();
+        aux::PPixelCallback pcb = new PixelCallback(std::move(cb));
+        return Request(aux::Convert(svg.data(), svg.size(), pcb, meta, "", 1.0f,
+                                    x, y, width, height, zoom,
+                                    static_cast<int>(aux::backend), static_cast<int>(aux::input),
+                                    static_cast<int>(aux::Output::Pixels), 0));
+    }
+
+    inline Request SvgToTexture(const std::string_view svg,
+                                const EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx,
+                                TextureCallback cb, void *meta, const float x, const float y,
+                                const float width, const float height, const float zoom) {
+        assert(width >= 0 and height >= 0 and zoom > 0
+               && "Wrong arguments [raster::SvgToTexture()]");
+        if (svg.empty() or svg[0] == '\0') {
+            cb(Texture(), Error::NoInputData, meta);
+            return {};
+        }
+        // svg not empty
+        aux::InitRuntime();
+        aux::PTextureCallback pcb = new TextureCallback(std::move(cb));
+        return Request(aux::Convert(svg.data(), svg.size(), pcb, meta, "", 1.0f,
+                                    x, y, width, height, zoom,
+                                    static_cast<int>(aux::backend), static_cast<int>(aux::input),
+                                    static_cast<int>(aux::Output::Texture), ctx));
+    }
+
+    inline Request SvgToTiles(const std::string_view svg, const int tile_size, TileCallback cb,
+                              void *meta, const std::string& format, const float quality,
+                              const float width, const float height, const float zoom) {
+        assert(tile_size > 0 and width >= 0 and height >= 0 and zoom > 0
+               && "Wrong arguments [raster::SvgToTiles()]");
+        if (svg.empty() or svg[0] == '\0') {
+            cb(Tile(), Error::NoInputData, true, meta);
+            return {};
+        }
+        // svg not empty
+        aux::InitRuntime();
+        aux::PTileCallback pcb = new TileCallback(std::move(cb));
+        std::string buf;
+        const std::string_view src = aux::PrepareSvg(svg, static_cast<int>(aux::input), buf);
+        return Request(aux::SvgToTiles(src.data(), src.size(), pcb, meta, format.c_str(),
+                                       quality, width, height, zoom, tile_size,
+                                       static_cast<int>(aux::input),
+                                       static_cast<int>(aux::Output::Tiles)));
+    }
+
+    inline Request SvgToProgressive(const std::string_view svg, ProgressiveCallback cb,
+                                    void *meta, const std::string& format, const float quality,
+                                    const float x, const float y, const float width,
+                                    const float height, const float zoom,
+                                    const Preview &preview) {
+        assert(width >= 0 and height >= 0 and zoom > 0 and preview.scale > 0
+               && "Wrong arguments [raster::SvgToProgressive()]");
+        if (svg.empty() or svg[0] == '\0') {
+            cb(Frame(), Error::NoInputData, false, meta);
+            return {};
+        }
+        // svg not empty
+        aux::InitRuntime();
+        aux::PProgressiveCallback pcb = new ProgressiveCallback(std::move(cb));
+        std::string buf;
+        const std::string_view src = aux::PrepareSvg(svg, static_cast<int>(aux::input), buf);
+        return Request(aux::SvgToProgressive(src.data(), src.size(), pcb, meta, format.c_str(),
+                                             quality, x, y, width, height, zoom,
+                                             static_cast<int>(aux::backend),
+                                             static_cast<int>(aux::input),
+                                             static_cast<int>(aux::Output::Progressive),
+                                             preview.format.c_str(), preview.quality,
+                                             preview.scale,
+                                             static_cast<double>(preview.min_pixels)));
+    }
+
+    inline void SvgToTargets(const std::string_view svg, const std::span<const Target> targets,
+                             TargetsCallback cb, void *meta) {
+        if (targets.empty()) {
+            cb({}, meta);
+            return;
+        }
+        if (svg.empty() or svg[0] == '\0') {
+            const std::vector<Result> results(targets.size(), {{}, Error::NoInputData});
+            cb(results, meta);
+            return;
+        }
+        // svg not empty
+        aux::InitRuntime();
+        const std::vector<aux::TargetDesc> descs = aux::ToTargetDescs(targets);
+        aux::PTargetsCallback pcb = new TargetsCallback(std::move(cb));
+        std::string buf;
+        const std::string_view src = aux::PrepareSvg(svg, static_cast<int>(aux::input), buf);
+        aux::SvgToTargets(src.data(), src.size(), pcb, meta, descs.data(), descs.size(),
+                          static_cast<int>(aux::backend), static_cast<int>(aux::input), 0);
+    }
+
+    inline void SvgToTargets(const std::string_view svg, const std::span<const Target> targets,
+                             TargetCallback cb, void *meta) {
+        if (targets.empty()) return;
+        if (svg.empty() or svg[0] == '\0') {
+            for (std::size_t i = 0; i < targets.size(); ++i) {
+                cb(i, std::string_view(), Error::NoInputData, meta);
+            }
+            return;
+        }
+        // svg not empty
+        aux::InitRuntime();
+        const std::vector<aux::TargetDesc> descs = aux::ToTargetDescs(targets);
+        aux::PTargetCallback pcb = new TargetCallback(std::move(cb));
+        std::string buf;
+        const std::string_view src = aux::PrepareSvg(svg, static_cast<int>(aux::input), buf);
+        aux::SvgToTargets(src.data(), src.size(), pcb, meta, descs.data(), descs.size(),
+                          static_cast<int>(aux::backend), static_cast<int>(aux::input), 1);
+    }
+
+    inline Request SvgHandle::Render(const Target &target, Callback cb, void *meta) const {
+        assert(target.width >= 0 and target.height >= 0 and target.zoom > 0
+               && "Wrong arguments [raster::SvgHandle::Render()]");
+        if (id_ == 0) {
+            cb(std::string_view(), Error::NoInputData, meta);
+            return {};
+        }
+        const void *pcb = new Callback(std::move(cb));
+        const int output = aux::WrapEncoder(target.format.c_str(),
+                                            static_cast<int>(aux::Output::Encoded),
+                                            target.level);
+        return Request(aux::RenderHandle(id_, pcb, meta, target.format.c_str(), target.quality,
+                                         target.x, target.y, target.width, target.height,
+                                         target.zoom, static_cast<int>(aux::backend),
+                                         output, 0));
+    }
+
+    inline Request SvgHandle::Render(const Target &target, PixelCallback cb, void *meta) const {
+        assert(target.width >= 0 and target.height >= 0 and target.zoom > 0
+               && "Wrong arguments [raster::SvgHandle::Render()]");
+        if (id_ == 0) {
+            cb(Pixels(), Error::NoInputData, meta);
+            return {};
+        }
+        aux::PPixelCallback pcb = new PixelCallback(std::move(cb));
+        return Request(aux::RenderHandle(id_, pcb, meta, "", 1.0f,
+                                         target.x, target.y, target.width, target.height,
+                                         target.zoom, static_cast<int>(aux::backend),
+                                         static_cast<int>(aux::Output::Pixels), 0));
+    }
+
+    inline Request SvgHandle::Render(const Target &target,
+                                     const EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx,
+                                     TextureCallback cb, void *meta) const {
+        assert(target.width >= 0 and target.height >= 0 and target.zoom > 0
+               && "Wrong arguments [raster::SvgHandle::Render()]");
+        if (id_ == 0) {
+            cb(Texture(), Error::NoInputData, meta);
+            return {};
+        }
+        aux::PTextureCallback pcb = new TextureCallback(std::move(cb));
+        return Request(aux::RenderHandle(id_, pcb, meta, "", 1.0f,
+                                         target.x, target.y, target.width, target.height,
+                                         target.zoom, static_cast<int>(aux::backend),
+                                         static_cast<int>(aux::Output::Texture), ctx));
+    }
+
+    inline void SvgHandle::Release() noexcept {
+        if (id_ != 0) aux::ReleaseHandle(std::exchange(id_, 0));
+    }
+
+    inline SvgHandle LoadSvg(const std::string_view svg) {
+        if (svg.empty() or svg[0] == '\0') return {};
+        aux::InitRuntime();
+        std::string buf;
+        const std::string_view src = aux::PrepareSvg(svg, static_cast<int>(aux::input), buf);
+        return SvgHandle(aux::LoadHandle(src.data(), src.size(), static_cast<int>(aux::input)));
+    }
+
+    inline Request BuildAtlas(const std::span<const std::string_view> svgs, const int max_size,
+                              AtlasCallback cb, void *meta, const float zoom, const int padding) {
+        return BuildAtlas(svgs, max_size, 0, std::move(cb), meta, zoom, padding);
+    }
+
+    inline Request BuildAtlas(const std::span<const std::string_view> svgs, const int max_size,
+                              const EMSCRIPTEN_WEBGL_CONTEXT_HANDLE ctx, AtlasCallback cb,
+                              void *meta, const float zoom, const int padding) {
+        assert(max_size > 0 and zoom > 0 and padding >= 0
+               && "Wrong arguments [raster::BuildAtlas()]");
+        if (svgs.empty()) {
+            cb(Atlas(), Error::NoInputData, meta);
+            return {};
+        }
+        aux::InitRuntime();
+        auto *preq = new aux::AtlasRequest{std::move(cb), {}, max_size, padding};
+        preq->atlas.rects.resize(svgs.size());
+        // The preprocessed svgs are alive until JS reads them (see aux::PrepareSvg()).
+        std::vector<std::string> bufs(svgs.size());
+        std::vector<aux::SvgDesc> descs(svgs.size());
+        for (std::size_t i = 0; i < svgs.size(); ++i) {
+            if (svgs[i].empty() or svgs[i][0] == '\0') {
+                preq->atlas.rects[i].err = Error::NoInputData;
+                descs[i] = {nullptr, 0};
+                continue;
+            }
+            const std::string_view src = aux::PrepareSvg(svgs[i], static_cast<int>(aux::input),
+                                                         bufs[i]);
+            descs[i] = {src.data(), src.size()};
+        }
+        return Request(aux::BuildAtlas(preq, meta, descs.data(), descs.size(), zoom,
+                                       static_cast<int>(aux::input),
+                                       static_cast<int>(aux::Output::Atlas), ctx));
+    }
+
+    inline void SvgToImages(const std::span<Job> jobs, BatchCallback cb, void *meta,
+                            const std::size_t max_in_flight) {
+        assert(max_in_flight > 0 && "Wrong arguments [raster::SvgToImages()]");
+        aux::InitRuntime();
+        auto *batch = new aux::Batch();
+        batch->jobs.reserve(jobs.size());
+        std::move(jobs.begin(), jobs.end(), std::back_inserter(batch->jobs));
+        for (Job &job : batch->jobs) job.level = aux::EncoderLevel(job.level);
+        batch->queue.resize(jobs.size());
+        for (std::size_t i = 0; i < batch->queue.size(); ++i) batch->queue[i] = i;
+        std::stable_sort(batch->queue.begin(), batch->queue.end(),
+                         [batch](const std::size_t lhs, const std::size_t rhs) {
+                             return batch->jobs[lhs].priority > batch->jobs[rhs].priority;
+                         });
+        batch->max_in_flight = max_in_flight;
+        batch->cb = std::move(cb);
+        batch->meta = meta;
+        aux::Dispatch(batch);
+    }
+
+    inline Cache::Cache(const std::size_t budget, const Delivery delivery)
+        : state_(std::make_shared<aux::CacheState>()) {
+        state_->budget = budget;
+        state_->delivery = delivery;
+    }
+
+    inline void Cache::SvgToImage(const std::string_view svg, Callback cb, void *meta,
+                                  const std::string& format, const float quality,
+                                  const float x, const float y,
+                                  const float width, const float height, const float zoom) {
+        if (svg.empty() or svg[0] == '\0') {
+            raster::SvgToImage(svg, std::move(cb), meta, format, quality,
+                               x, y, width, height, zoom);
+            return;
+        }
+        // svg not empty
+        aux::CacheKey key = aux::MakeCacheKey(svg, format, quality, x, y, width, height, zoom, -1);
+        if (aux::CacheState::Image img = state_->Find(key)) {
+            ++state_->stats.hits;
+            if (state_->delivery == Delivery::NextTick) {
+                emscripten_async_call(aux::DeliverCacheHit,
+                                      new aux::CacheHit{std::move(cb), std::move(img), meta}, 0);
+            } else {
+                cb(*img, Error::None, meta);
+            }
+            return;
+        }
+        // miss
+        ++state_->stats.misses;
+        auto on_done = [state = state_, key = std::move(key), cb = std::move(cb)]
+                (const std::string_view img, const Error err, void *meta) {
+            if (err == Error::None) state->Insert(key, img);
+            cb(img, err, meta);
+        };
+        raster::SvgToImage(svg, std::move(on_done), meta, format, quality,
+                           x, y, width, height, zoom);
+    }
+
+    inline void aux::SchedulerState::Start(const std::size_t cost, const std::string_view svg,
+                                           Callback cb, void *meta, const std::string &format,
+                                           const float quality, const float x, const float y,
+                                           const float width, const float height,
+                                           const float zoom, const int level) {
+        ++stats.in_flight;
+        stats.in_flight_bytes += cost;
+        stats.peak_bytes = std::max(stats.peak_bytes, stats.in_flight_bytes);
+        auto on_done = [state = shared_from_this(), cost, cb = std::move(cb)]
+                (const std::string_view img, const Error err, void *meta) {
+            --state->stats.in_flight;
+            state->stats.in_flight_bytes -= cost;
+            ++state->stats.completed;
+            cb(img, err, meta);
+            state->Dispatch();
+        };
+        ConvertEncoded(svg, std::move(on_done), meta, format, quality,
+                       x, y, width, height, zoom, level);
+    }
+
+    inline Scheduler::Scheduler(const std::size_t budget)
+        : state_(std::make_shared<aux::SchedulerState>()) {
+        state_->budget = budget;
+    }
+
+    inline void Scheduler::SvgToImage(const int priority, const std::string_view svg,
+                                      Callback cb, void *meta, const std::string& format,
+                                      const float quality, const float x, const float y,
+                                      const float width, const float height,
+                                      const float zoom) {
+        assert(width >= 0 and height >= 0 and zoom > 0
+               && "Wrong arguments [raster::Scheduler::SvgToImage()]");
+        ++state_->stats.submitted;
+        std::pair<float, float> size{width, height};
+        if (width == 0 or height == 0) {
+            const std::pair<float, float> intrinsic = aux::SvgSize(svg);
+            if (width == 0) size.first = intrinsic.first;
+            if (height == 0) size.second = intrinsic.second;
+        }
+        const auto cost = static_cast<std::size_t>(
+            static_cast<double>(size.first) * size.second * zoom * zoom * 4.0);
+        // Nothing waits ahead of the conversion if the queue is empty
+        // or its head has lower priority (it goes to the queue head).
+        const bool ahead = state_->queue.empty() or state_->queue.front().priority < priority;
+        const int level = aux::EncoderLevel(-1); // deferred jobs keep the current level
+        if (ahead and state_->Admits(cost)) {
+            state_->Start(cost, svg, std::move(cb), meta, format, quality,
+                          x, y, width, height, zoom, level);
+            return;
+        }
+        ++state_->stats.deferred;
+        ++state_->stats.queued;
+        state_->queue.push_back({priority, state_->seq++, cost, std::string(svg), std::move(cb),
+                                 meta, format, quality, x, y, width, height, zoom, level});
+        std::push_heap(state_->queue.begin(), state_->queue.end(), aux::SchedulerState::After);
+    }
+
+    inline void Scheduler::SetBudget(const std::size_t budget) {
+        state_->budget = budget;
+        state_->Dispatch();
+    }
+
+    inline std::size_t Scheduler::GetBudget() const { return state_->budget; }
+
+    inline SchedulerStats Scheduler::GetStats() const { return state_->stats; }
+
+    inline void Cache::SetBudget(const std::size_t budget) {
+        state_->budget = budget;
+        state_->Evict();
+    }
+
+    inline std::size_t Cache::GetBudget() const { return state_->budget; }
+
+    inline void Cache::Clear() { state_->Clear(); }
+
+    inline CacheStats Cache::GetStats() const { return state_->stats; }
+
+    inline void SetStats(const bool enabled, StatsSink sink) {
+        aux::InitRuntime();
+        aux::EnableStats(enabled);
+        aux::stats_enabled = enabled;
+        aux::stats_sink = std::move(sink);
+    }
+
+    inline const Stats &GetStats() { return aux::stats; }
+
+    inline void ResetStats() { aux::stats = Stats(); }
+
+    inline void Request::Cancel() const {
+        if (id_ < 0) aux::DetachWaiter(-id_, Error::Cancelled);
+        else if (id_ != 0) aux::CancelRequest(id_, static_cast<int>(Error::Cancelled));
+    }
+
+    inline void Request::SetTimeout(const double ms) const {
+        assert(ms >= 0 && "Wrong arguments [raster::Request::SetTimeout()]");
+        if (id_ < 0) aux::SetWaiterTimeout(-id_, ms);
+        else if (id_ != 0) aux::SetRequestTimeout(id_, ms);
+    }
+
+    inline void ImageAwaitable::Start() {
+        aux::InitRuntime();
+        aux::Convert(svg_.data(), svg_.size(), &state_, nullptr, format_.c_str(),
+                     quality_, x_, y_, width_, height_, zoom_,
+                     static_cast<int>(aux::backend), static_cast<int>(aux::input),
+                     static_cast<int>(aux::Output::Async), 0, level_);
+    }
+
+    inline bool WhenAllAwaitable::await_suspend(const std::coroutine_handle<> handle) {
+        // One extra count guards the loop: the last conversion may complete synchronously,
+        // and the resumed coroutine would destroy ops_ while we are iterating over them.
+        pending_ = ops_.size() + 1;
+        for (ImageAwaitable &op : ops_) {
+            if (op.await_ready()) {
+                --pending_;
+                continue;
+            }
+            op.state_.handle = handle;
+            op.state_.pending = &pending_;
+            op.Start();
+        }
+        // Don't suspend if all conversions are already completed.
+        return --pending_ != 0;
+    }
+
+    inline std::vector<Expected<ImageBuffer>> WhenAllAwaitable::await_resume() {
+        std::vector<Expected<ImageBuffer>> results;
+        results.reserve(ops_.size());
+        for (ImageAwaitable &op : ops_) results.push_back(op.await_resume());
+        return results;
+    }
+
+    inline ImageAwaitable SvgToImageAsync(const std::string_view svg, std::string format,
+                                          const float quality, const float x, const float y,
+                                          const float width, const float height,
+                                          const float zoom) {
+        return {svg, std::move(format), quality, x, y, width, height, zoom,
+                aux::EncoderLevel(-1)};
+    }
+
+    inline WhenAllAwaitable WhenAll(std::vector<ImageAwaitable> ops) {
+        return WhenAllAwaitable(std::move(ops));
+    }
+
+    inline void SetBackend(const Backend backend) { aux::backend = backend; }
+
+    inline Backend GetBackend() { return aux::backend; }
+
+    inline void SetRasterizer(std::shared_ptr<Rasterizer> rasterizer) {
+        aux::rasterizer = std::move(rasterizer);
+    }
+
+    inline const std::shared_ptr<Rasterizer> &GetRasterizer() { return aux::rasterizer; }
+
+    inline void SetWorkerPool(const std::size_t size, const std::size_t queue_depth,
+                              const std::size_t arena_size) {
+        assert(queue_depth > 0 && "Wrong arguments [raster::SetWorkerPool()]");
+        aux::InitRuntime();
+        aux::SetWorkerPool(static_cast<int>(size), static_cast<int>(queue_depth),
+                           static_cast<double>(arena_size));
+    }
+
+    inline std::vector<WorkerStats> GetWorkerStats() {
+        constexpr int max_workers = 256;
+        constexpr std::size_t fields = 5;
+        aux::InitRuntime();
+        std::vector<double> raw(max_workers * fields);
+        const int count = aux::ReadWorkerStats(raw.data(), max_workers);
+        std::vector<WorkerStats> workers(count);
+        for (int i = 0; i < count; ++i) {
+            const double *p = raw.data() + i * fields;
+            workers[i] = {static_cast<std::size_t>(p[0]), static_cast<std::size_t>(p[1]),
+                          static_cast<std::size_t>(p[2]), p[3], p[4]};
+        }
+        return workers;
+    }
+
+    inline void SetCanvasPool(const std::size_t capacity) {
+        aux::InitRuntime();
+        aux::SetCanvasPool(static_cast<int>(capacity));
+    }
+
+    inline CanvasPoolStats GetCanvasPoolStats() {
+        aux::InitRuntime();
+        double raw[4] = {};
+        aux::ReadCanvasPoolStats(raw);
+        return {static_cast<std::size_t>(raw[0]), static_cast<std::size_t>(raw[1]),
+                static_cast<std::size_t>(raw[2]), static_cast<std::size_t>(raw[3])};
+    }
+
+    inline void SetOutputArena(const std::size_t capacity) {
+        aux::InitRuntime();
+        aux::SetOutputArena(static_cast<double>(capacity));
+    }
+
+    inline OutputArenaStats GetOutputArenaStats() {
+        aux::InitRuntime();
+        double raw[4] = {};
+        aux::ReadOutputArenaStats(raw);
+        return {static_cast<std::size_t>(raw[0]), static_cast<std::size_t>(raw[1]),
+                static_cast<std::size_t>(raw[2]), static_cast<std::size_t>(raw[3])};
+    }
+
+    inline void SetDeferredCompletions(const bool enabled) {
+        aux::InitRuntime();
+        aux::SetDeferredCompletions(enabled);
+    }
+
+    inline std::size_t PumpCompletions(const double budget_ms) {
+        assert(budget_ms >= 0 && "Wrong arguments [raster::PumpCompletions()]");
+        aux::InitRuntime();
+        return static_cast<std::size_t>(aux::PumpCompletions(budget_ms));
+    }
+
+    inline std::size_t GetQueuedCompletions() {
+        aux::InitRuntime();
+        return static_cast<std::size_t>(aux::QueuedCompletions());
+    }
+
+    inline void SetInput(const Input input) { aux::input = input; }
+
+    inline Input GetInput() { return aux::input; }
+
+    inline void SetEncoder(const Encoder encoder, const int level) {
+        assert(level >= 0 and level <= 9 && "Wrong arguments [raster::SetEncoder()]");
+        aux::encoder = encoder;
+        aux::encoder_level = level;
     }
 
+    inline Encoder GetEncoder() { return aux::encoder; }
+
+    inline int GetEncoderLevel() { return aux::encoder_level; }
+
+    inline void SetCoalescing(const bool enabled) { aux::coalescing = enabled; }
+
+    inline bool GetCoalescing() { return aux::coalescing; }
+
+    inline void SetMinify(const bool enabled) { aux::minify = enabled; }
+
+    inline bool GetMinify() { return aux::minify; }
+
     inline const char *ToCStr(const Error err) {
         switch (err) {
             case Error::None: return "raster::Error::None";
@@ -266,6 +6072,10 @@ namespace raster {
             case Error::ImgLoadingFailed: return "raster::Error::ImgLoadingFailed";
             case Error::CanvasDrawingFailed: return "raster::Error::CanvasDrawingFailed";
             case Error::BlobExportFailed: return "raster::Error::BlobExportFailed";
+            case Error::TextureUploadFailed: return "raster::Error::TextureUploadFailed";
+            case Error::Cancelled: return "raster::Error::Cancelled";
+            case Error::Timeout: return "raster::Error::Timeout";
+            case Error::NoRasterizer: return "raster::Error::NoRasterizer";
             default: assert(false && "Invalid error code [raster::ToCStr()]");
         }
         return nullptr; // unreachable, need to suppress compiler warning
@@ -277,11 +6087,52 @@ namespace raster {
             case Format::Jpeg: return "jpeg";
             case Format::Webp: return "webp";
             case Format::Unknown: return "unknown";
+            case Format::RawRgba: return "rgba";
             default: assert(false && "Invalid format code [raster::ToCStr()]");
         }
         return nullptr; // unreachable, need to suppress compiler warning
     }
 
+    inline const char *ToCStr(const Backend backend) {
+        switch (backend) {
+            case Backend::Main: return "raster::Backend::Main";
+            case Backend::Worker: return "raster::Backend::Worker";
+            case Backend::Native: return "raster::Backend::Native";
+            default: assert(false && "Invalid backend code [raster::ToCStr()]");
+        }
+        return nullptr; // unreachable, need to suppress compiler warning
+    }
+
+    inline const char *ToCStr(const Input input) {
+        switch (input) {
+            case Input::DataUri: return "raster::Input::DataUri";
+            case Input::Blob: return "raster::Input::Blob";
+            case Input::Uri: return "raster::Input::Uri";
+            default: assert(false && "Invalid input code [raster::ToCStr()]");
+        }
+        return nullptr; // unreachable, need to suppress compiler warning
+    }
+
+    inline const char *ToCStr(const Stage stage) {
+        switch (stage) {
+            case Stage::Encode: return "raster::Stage::Encode";
+            case Stage::Load: return "raster::Stage::Load";
+            case Stage::Draw: return "raster::Stage::Draw";
+            case Stage::Export: return "raster::Stage::Export";
+            case Stage::Read: return "raster::Stage::Read";
+            case Stage::Copy: return "raster::Stage::Copy";
+            case Stage::Total: return "raster::Stage::Total";
+            default: assert(false && "Invalid stage code [raster::ToCStr()]");
+        }
+        return nullptr; // unreachable, need to suppress compiler warning
+    }
+
+    inline std::string MinifySvg(const std::string_view svg) {
+        std::string out;
+        aux::MinifySvg(svg, out);
+        return out;
+    }
+
     inline std::string GetImageHeader(const std::string_view img, const std::size_t pos,
                                       const std::size_t n) {
         std::ostringstream out;
@@ -297,20 +6148,60 @@ namespace raster {
         return header;
     }
 
-    inline Format GetImageFormat(const std::string_view img) {
-        const char* png_sig = "89 50 4E 47 0D 0A 1A 0A"; // ASCII ? 'PNG' ...
-        const char* jpeg_sig = "FF D8";
-        const char* riff_sig = "52 49 46 46"; // ASCII 'RIFF'
-        const char* webp_sig = "57 45 42 50"; // ASCII 'WEBP'
-        if (GetImageHeader(img, 0, 8) == png_sig)
-            return Format::Png;
-        if (GetImageHeader(img, 0, 2) == jpeg_sig)
-            return Format::Jpeg;
-        if (GetImageHeader(img, 0, 4) == riff_sig
-            and GetImageHeader(img, 8, 4) == webp_sig)
-            return Format::Webp;
+    constexpr ImageInfo GetImageInfo(const std::string_view img) noexcept {
+        ImageInfo info;
+        if (aux::Matches(img, 0, "\x89PNG\r\n\x1A\n")) { // ASCII ? 'PNG' ...
+            info.format = Format::Png;
+            aux::ParsePng(img, info);
+        } else if (aux::Matches(img, 0, "\xFF\xD8")) {
+            info.format = Format::Jpeg;
+            aux::ParseJpeg(img, info);
+        } else if (aux::Matches(img, 0, "RIFF") and aux::Matches(img, 8, "WEBP")) {
+            info.format = Format::Webp;
+            aux::ParseWebp(img, info);
+        }
         // Other
-        return Format::Unknown;
+        return info;
+    }
+
+    constexpr Format GetImageFormat(const std::string_view img) noexcept {
+        return GetImageInfo(img).format;
+    }
+
+    namespace aux {
+        // Returns true if GetImageInfo() of the header literal (with the embedded zeros)
+        // is the expected one.
+        template<std::size_t N>
+        constexpr bool Parses(const char (&img)[N], const ImageInfo expected) {
+            const ImageInfo info = GetImageInfo(std::string_view(img, N - 1));
+            return info.format == expected.format and info.width == expected.width
+                   and info.height == expected.height and info.bit_depth == expected.bit_depth
+                   and info.alpha == expected.alpha;
+        }
+
+        // Png: IHDR of 640x480 rgb + alpha; truncated within IHDR.
+        static_assert(Parses("\x89PNG\r\n\x1A\n\0\0\0\x0DIHDR\0\0\x02\x80\0\0\x01\xE0\x08\x06",
+                             {Format::Png, 640, 480, 8, true}));
+        static_assert(Parses("\x89PNG\r\n\x1A\n\0\0\0\x0DIHDR\0\0\x02",
+                             {Format::Png, 0, 0, 0, false}));
+        // Jpeg: APP0 and fill bytes before SOF2 of 640x480; SOS before SOFn; truncated SOFn.
+        static_assert(Parses("\xFF\xD8\xFF\xE0\0\x04JF\xFF\xFF\xC2\0\x11\x08\x01\xE0\x02\x80",
+                             {Format::Jpeg, 640, 480, 8, false}));
+        static_assert(Parses("\xFF\xD8\xFF\xDA\0\x0C\xFF\xC0\0\x11\x08\x01\xE0\x02\x80",
+                             {Format::Jpeg, 0, 0, 0, false}));
+        static_assert(Parses("\xFF\xD8\xFF\xC0\0\x11\x08\x01\xE0\x02",
+                             {Format::Jpeg, 0, 0, 0, false}));
+        // Webp: lossy 300x200, lossless 300x200 with alpha, extended 4000x3000 with alpha;
+        // truncated VP8L.
+        static_assert(Parses("RIFF\0\0\0\0WEBPVP8 \0\0\0\0\0\0\0\x9D\x01\x2A\x2C\x01\xC8\x00",
+                             {Format::Webp, 300, 200, 8, false}));
+        static_assert(Parses("RIFF\0\0\0\0WEBPVP8L\0\0\0\0\x2F\x2B\xC1\x31\x10",
+                             {Format::Webp, 300, 200, 8, true}));
+        static_assert(Parses("RIFF\0\0\0\0WEBPVP8X\0\0\0\0\x10\0\0\0\x9F\x0F\0\xB7\x0B\0",
+                             {Format::Webp, 4000, 3000, 8, true}));
+        static_assert(Parses("RIFF\0\0\0\0WEBPVP8L\0\0\0\0\x2F\x2B\xC1",
+                             {Format::Webp, 0, 0, 0, false}));
+        static_assert(Parses("GIF89a", {}) and Parses("", {}));
     }
 }
 